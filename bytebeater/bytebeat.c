@@ -0,0 +1,635 @@
+/*
+ * bytebeat.c - play bytebeat formulas given on the command line
+ *
+ *   ./bin/bytebeat 't*((t>>12|t>>8)&63&t>>4)' | sox -t raw -r 8000 -e unsigned-integer -b 8 -c 1 - -d
+ *
+ * The formula is an expression over t (the sample number) using C's integer
+ * operators and precedence:
+ *   ?:  ||  &&  |  ^  &  == !=  < <= > >=  << >>  + -  * / %  unary - ~ ! +
+ * plus decimal/hex literals, parentheses and string lookups like "CWG[Cg"[t>>11&7].
+ * Values are 32-bit signed and wrap on overflow; x/0 and x%0 give 0, and
+ * shift counts are taken mod 32. The low 8 bits of the result are the sample.
+ *
+ * The expression is compiled to register bytecode with constants folded.
+ * Each register holds a whole block of BB_BLOCK values of t, and each
+ * instruction is a plain loop over the block, which the compiler vectorizes.
+ * Interpreter dispatch is paid once per block rather than once per sample.
+ *
+ *   bytebeat [format flags, see pcm_out.h] 'formula'
+ *   bytebeat --dump 'formula'      print the bytecode
+ *   bytebeat --bench [samples]     compare with the hand-written C versions
+ */
+
+#include "pcm_out.h"
+#include <ctype.h>
+#include <time.h>
+#include <math.h>
+
+#define BB_BLOCK 256               // values of t per instruction
+#define BB_MAX_REGS 64
+#define BB_MAX_INSNS 1024
+#define BB_MAX_NODES 4096
+#define BB_MAX_STRINGS 32
+#define BB_MAX_DEPTH 256            // nested (), ?: and unary operators
+#define R_T 0                       // register 0 always holds t
+
+typedef enum {
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+    OP_AND, OP_OR, OP_XOR, OP_SHL, OP_SHR,
+    OP_LT, OP_LE, OP_EQ, OP_NE, OP_LAND, OP_LOR,
+    OP_NEG, OP_NOT, OP_LNOT,
+    OP_SEL,                         // dst = a ? b : c
+    OP_INDEX,                       // dst = strings[b][a], 0 out of range
+    OP_CONST,                       // parse tree only: a literal
+    OP_T                            // parse tree only: t
+} OpCode;
+
+static const char *op_names[] = {
+    "add", "sub", "mul", "div", "mod", "and", "or", "xor", "shl", "shr",
+    "lt", "le", "eq", "ne", "land", "lor", "neg", "not", "lnot", "sel", "index",
+};
+
+typedef struct {
+    uint8_t op, dst, a, b, c;
+} Insn;
+
+typedef struct {
+    const char *text;
+    int len;
+} BbString;
+
+typedef struct {
+    Insn code[BB_MAX_INSNS];
+    int n_code;
+    int32_t consts[BB_MAX_REGS];    // value of each constant register
+    bool is_const[BB_MAX_REGS];
+    int n_regs;
+    int result;                     // register holding the sample
+    BbString strings[BB_MAX_STRINGS];
+    int n_strings;
+} Program;
+
+// Parse tree node; leaves are OP_CONST (value) and OP_T
+typedef struct {
+    OpCode op;
+    int32_t value;
+    int kids[3];
+} Node;
+
+typedef struct {
+    const char *src, *p;
+    Node nodes[BB_MAX_NODES];
+    int n_nodes;
+    Program *prog;
+    bool temp_busy[BB_MAX_REGS];
+    int uses[BB_MAX_NODES];         // parents still to read each node's value
+    int reg_of[BB_MAX_NODES];       // register holding it once generated, or -1
+    int depth;                      // parser recursion, bounded by BB_MAX_DEPTH
+    const char *error;
+} Compiler;
+
+// Function to divide as C does, with x/0 = 0 and INT_MIN/-1 wrapping. Goes
+// through double so the block loop vectorizes: for 32-bit operands the
+// rounded quotient never crosses an integer, so truncating it is exact.
+static inline int32_t bb_div(int32_t a, int32_t b) {
+    int32_t q = (int32_t)((double)a / (double)(b == 0 || b == -1 ? 1 : b));
+    return b == 0 ? 0 : b == -1 ? (int32_t)(0u - (uint32_t)a) : q;
+}
+
+static inline int32_t bb_mod(int32_t a, int32_t b) {
+    return b == 0 ? 0 : (int32_t)((uint32_t)a - (uint32_t)bb_div(a, b) * (uint32_t)b);
+}
+
+// Function to apply one operator to one set of values; the block evaluator
+// below and constant folding both follow it exactly
+static inline int32_t bb_apply(OpCode op, int32_t a, int32_t b, int32_t c) {
+    switch (op) {
+        case OP_ADD: return (int32_t)((uint32_t)a + (uint32_t)b);
+        case OP_SUB: return (int32_t)((uint32_t)a - (uint32_t)b);
+        case OP_MUL: return (int32_t)((uint32_t)a * (uint32_t)b);
+        case OP_DIV: return bb_div(a, b);
+        case OP_MOD: return bb_mod(a, b);
+        case OP_AND: return a & b;
+        case OP_OR: return a | b;
+        case OP_XOR: return a ^ b;
+        case OP_SHL: return (int32_t)((uint32_t)a << (b & 31));
+        case OP_SHR: return a >> (b & 31);
+        case OP_LT: return a < b;
+        case OP_LE: return a <= b;
+        case OP_EQ: return a == b;
+        case OP_NE: return a != b;
+        case OP_LAND: return a && b;
+        case OP_LOR: return a || b;
+        case OP_NEG: return (int32_t)(0u - (uint32_t)a);
+        case OP_NOT: return ~a;
+        case OP_LNOT: return !a;
+        case OP_SEL: return a ? b : c;
+        default: return 0;
+    }
+}
+
+/* ---- Parser: precedence climbing straight into the node array ---- */
+
+static int new_node(Compiler *cc, OpCode op, int32_t value, int a, int b, int c) {
+    if (cc->error) return 0;
+    if (cc->n_nodes == BB_MAX_NODES) {
+        cc->error = "formula too long";
+        return 0;
+    }
+    Node *n = &cc->nodes[cc->n_nodes];
+    n->op = op;
+    n->value = value;
+    n->kids[0] = a;
+    n->kids[1] = b;
+    n->kids[2] = c;
+
+    // Fold operators whose operands are all literals
+    bool folds = op != OP_CONST && op != OP_T && op != OP_INDEX;
+    int arity = op == OP_SEL ? 3 : op >= OP_NEG ? 1 : 2;     // OP_INDEX never folds
+    for (int k = 0; folds && k < arity; k++) folds = cc->nodes[n->kids[k]].op == OP_CONST;
+    if (folds) {
+        n->value = bb_apply(op, cc->nodes[a].value, arity > 1 ? cc->nodes[b].value : 0,
+                            arity > 2 ? cc->nodes[c].value : 0);
+        n->op = OP_CONST;
+        n->kids[0] = n->kids[1] = n->kids[2] = 0;
+    }
+
+    // Reuse an identical earlier node, so repeated subexpressions such as
+    // the t/16000%3 in every term of a chord formula are computed once
+    for (int i = 0; i < cc->n_nodes; i++) {
+        const Node *m = &cc->nodes[i];
+        if (m->op == n->op && m->value == n->value && m->kids[0] == n->kids[0] &&
+            m->kids[1] == n->kids[1] && m->kids[2] == n->kids[2]) return i;
+    }
+    return cc->n_nodes++;
+}
+
+static void skip_space(Compiler *cc) {
+    while (isspace((unsigned char)*cc->p)) cc->p++;
+}
+
+static bool accept(Compiler *cc, const char *tok) {
+    skip_space(cc);
+    size_t n = strlen(tok);
+    if (strncmp(cc->p, tok, n) != 0) return false;
+
+    // Don't split "<<" into "<" "<", "&&" into "&" "&", and so on
+    if (n == 1 && strchr("<>&|=", tok[0]) && cc->p[1] == tok[0]) return false;
+    if (n == 1 && strchr("<>!=", tok[0]) && cc->p[1] == '=') return false;
+    cc->p += n;
+    return true;
+}
+
+static void expect(Compiler *cc, const char *tok) {
+    if (!accept(cc, tok) && !cc->error) cc->error = tok[0] == ')' ? "expected )" : tok[0] == ']' ? "expected ]" : "expected :";
+}
+
+static int parse_expr(Compiler *cc);
+
+static int parse_primary(Compiler *cc) {
+    skip_space(cc);
+    if (accept(cc, "(")) {
+        int e = parse_expr(cc);
+        expect(cc, ")");
+        return e;
+    }
+    if (*cc->p == 't' && !isalnum((unsigned char)cc->p[1]) && cc->p[1] != '_') {
+        cc->p++;
+        return new_node(cc, OP_T, 0, 0, 0, 0);
+    }
+    if (isdigit((unsigned char)*cc->p)) {
+        char *end;
+        unsigned long long v = strtoull(cc->p, &end, 0);
+        cc->p = end;
+        return new_node(cc, OP_CONST, (int32_t)(uint32_t)v, 0, 0, 0);
+    }
+    if (*cc->p == '"') {
+        const char *start = ++cc->p;
+        while (*cc->p && *cc->p != '"') cc->p++;
+        if (!*cc->p) {
+            cc->error = "unterminated string";
+            return 0;
+        }
+        Program *prog = cc->prog;
+        if (prog->n_strings == BB_MAX_STRINGS) {
+            cc->error = "too many strings";
+            return 0;
+        }
+        prog->strings[prog->n_strings] = (BbString){ start, (int)(cc->p - start) };
+        cc->p++;
+        expect(cc, "[");
+        int index = parse_expr(cc);
+        expect(cc, "]");
+        return new_node(cc, OP_INDEX, 0, index, prog->n_strings++, 0);
+    }
+    if (!cc->error) cc->error = "expected t, a number, a string or (";
+    return 0;
+}
+
+// The parser recurses on (, ?: and unary operators, so nesting is
+// bounded to keep a hostile formula from running it off the stack
+static bool enter(Compiler *cc) {
+    if (cc->error) return false;
+    if (cc->depth == BB_MAX_DEPTH) {
+        cc->error = "formula nested too deeply";
+        return false;
+    }
+    cc->depth++;
+    return true;
+}
+
+static int parse_unary(Compiler *cc) {
+    if (!enter(cc)) return 0;
+    int e;
+    if (accept(cc, "-")) e = new_node(cc, OP_NEG, 0, parse_unary(cc), 0, 0);
+    else if (accept(cc, "~")) e = new_node(cc, OP_NOT, 0, parse_unary(cc), 0, 0);
+    else if (accept(cc, "!")) e = new_node(cc, OP_LNOT, 0, parse_unary(cc), 0, 0);
+    else if (accept(cc, "+")) e = parse_unary(cc);
+    else e = parse_primary(cc);
+    cc->depth--;
+    return e;
+}
+
+// Binary operators by C precedence, loosest first; swap marks > and >=,
+// which are < and <= with the operands exchanged
+typedef struct {
+    const char *tok;
+    OpCode op;
+    bool swap;
+} BinOp;
+
+static const BinOp binops[][4] = {
+    { { "||", OP_LOR, false } },
+    { { "&&", OP_LAND, false } },
+    { { "|", OP_OR, false } },
+    { { "^", OP_XOR, false } },
+    { { "&", OP_AND, false } },
+    { { "==", OP_EQ, false }, { "!=", OP_NE, false } },
+    { { "<=", OP_LE, false }, { ">=", OP_LE, true }, { "<", OP_LT, false }, { ">", OP_LT, true } },
+    { { "<<", OP_SHL, false }, { ">>", OP_SHR, false } },
+    { { "+", OP_ADD, false }, { "-", OP_SUB, false } },
+    { { "*", OP_MUL, false }, { "/", OP_DIV, false }, { "%", OP_MOD, false } },
+};
+#define BINOP_LEVELS (int)(sizeof(binops) / sizeof(binops[0]))
+
+static int parse_binary(Compiler *cc, int level) {
+    if (level == BINOP_LEVELS) return parse_unary(cc);
+    int left = parse_binary(cc, level + 1);
+    for (;;) {
+        const BinOp *found = NULL;
+        for (int i = 0; i < 4 && binops[level][i].tok && !found; i++) {
+            if (accept(cc, binops[level][i].tok)) found = &binops[level][i];
+        }
+        if (!found || cc->error) return left;
+        int right = parse_binary(cc, level + 1);
+        left = found->swap ? new_node(cc, found->op, 0, right, left, 0) : new_node(cc, found->op, 0, left, right, 0);
+    }
+}
+
+static int parse_expr(Compiler *cc) {
+    if (!enter(cc)) return 0;
+    int e = parse_binary(cc, 0);
+    if (accept(cc, "?")) {
+        int yes = parse_expr(cc);
+        expect(cc, ":");
+        int no = parse_expr(cc);
+        e = new_node(cc, OP_SEL, 0, e, yes, no);
+    }
+    cc->depth--;
+    return e;
+}
+
+/* ---- Code generation: one register per live value ---- */
+
+static int alloc_reg(Compiler *cc) {
+    Program *prog = cc->prog;
+    for (int r = 1; r < prog->n_regs; r++) {
+        if (!prog->is_const[r] && !cc->temp_busy[r]) {
+            cc->temp_busy[r] = true;
+            return r;
+        }
+    }
+    if (prog->n_regs == BB_MAX_REGS) {
+        if (!cc->error) cc->error = "formula needs too many registers";
+        return R_T;
+    }
+    cc->temp_busy[prog->n_regs] = true;
+    return prog->n_regs++;
+}
+
+static void release_reg(Compiler *cc, int r) {
+    if (r != R_T && !cc->prog->is_const[r]) cc->temp_busy[r] = false;
+}
+
+static int const_reg(Compiler *cc, int32_t v) {
+    Program *prog = cc->prog;
+    for (int r = 1; r < prog->n_regs; r++) {
+        if (prog->is_const[r] && prog->consts[r] == v) return r;
+    }
+    if (prog->n_regs == BB_MAX_REGS) {
+        if (!cc->error) cc->error = "formula needs too many registers";
+        return R_T;
+    }
+    prog->is_const[prog->n_regs] = true;
+    prog->consts[prog->n_regs] = v;
+    return prog->n_regs++;
+}
+
+static int node_arity(OpCode op) {
+    return op == OP_SEL ? 3 : op == OP_INDEX || (op >= OP_NEG && op <= OP_LNOT) ? 1 : op >= OP_CONST ? 0 : 2;
+}
+
+// Function to count how many parents read each node, visiting shared ones once
+static void count_uses(Compiler *cc, int node) {
+    if (cc->uses[node]++ > 0) return;
+    for (int k = 0; k < node_arity(cc->nodes[node].op); k++) count_uses(cc, cc->nodes[node].kids[k]);
+}
+
+static int gen(Compiler *cc, int node) {
+    const Node *n = &cc->nodes[node];
+    if (n->op == OP_T) return R_T;
+    if (n->op == OP_CONST) return const_reg(cc, n->value);
+    if (cc->reg_of[node] >= 0) return cc->reg_of[node];
+
+    int arity = node_arity(n->op);
+    int regs[3] = { 0, 0, 0 };
+    for (int k = 0; k < arity; k++) regs[k] = gen(cc, n->kids[k]);
+    for (int k = 0; k < arity; k++) {
+        if (--cc->uses[n->kids[k]] == 0) release_reg(cc, regs[k]);
+    }
+    if (n->op == OP_INDEX) regs[1] = n->kids[1];    // string number, not a register
+
+    // Operands are read before the result is written at each position,
+    // so the result may reuse an operand's register
+    int dst = alloc_reg(cc);
+    cc->reg_of[node] = dst;
+    Program *prog = cc->prog;
+    if (prog->n_code == BB_MAX_INSNS) {
+        if (!cc->error) cc->error = "formula too long";
+        return dst;
+    }
+    prog->code[prog->n_code++] = (Insn){ (uint8_t)n->op, (uint8_t)dst, (uint8_t)regs[0], (uint8_t)regs[1], (uint8_t)regs[2] };
+    return dst;
+}
+
+// Function to compile a formula; prints the error and returns -1 on failure
+int bb_compile(Program *prog, const char *src) {
+    static Compiler cc;
+    memset(&cc, 0, sizeof(cc));
+    memset(prog, 0, sizeof(*prog));
+    cc.src = cc.p = src;
+    cc.prog = prog;
+    prog->n_regs = 1;               // R_T
+
+    int root = parse_expr(&cc);
+    skip_space(&cc);
+    if (!cc.error && *cc.p) cc.error = "unexpected text";
+    if (!cc.error) {
+        for (int i = 0; i < cc.n_nodes; i++) cc.reg_of[i] = -1;
+        count_uses(&cc, root);
+        prog->result = gen(&cc, root);
+    }
+    if (cc.error) {
+        fprintf(stderr, "%s\n%*s^ %s\n", src, (int)(cc.p - src), "", cc.error);
+        return -1;
+    }
+    return 0;
+}
+
+void bb_dump(const Program *prog, FILE *f) {
+    for (int r = 1; r < prog->n_regs; r++) {
+        if (prog->is_const[r]) fprintf(f, "  r%-2d = %d\n", r, prog->consts[r]);
+    }
+    for (int i = 0; i < prog->n_code; i++) {
+        const Insn *in = &prog->code[i];
+        fprintf(f, "  %-5s r%d", op_names[in->op], in->dst);
+        if (in->op == OP_INDEX) {
+            const BbString *s = &prog->strings[in->b];
+            fprintf(f, ", \"%.*s\"[r%d]\n", s->len, s->text, in->a);
+        } else {
+            int arity = in->op == OP_SEL ? 3 : in->op >= OP_NEG ? 1 : 2;
+            fprintf(f, ", r%d", in->a);
+            if (arity > 1) fprintf(f, ", r%d", in->b);
+            if (arity > 2) fprintf(f, ", r%d", in->c);
+            fprintf(f, "\n");
+        }
+    }
+    fprintf(f, "  result r%d, %d registers of %d values\n", prog->result, prog->n_regs, BB_BLOCK);
+}
+
+/* ---- Block evaluator ---- */
+
+typedef int32_t BbRegs[BB_MAX_REGS][BB_BLOCK];
+
+// Function to fill the constant registers (once per program)
+void bb_load(const Program *prog, BbRegs regs) {
+    for (int r = 1; r < prog->n_regs; r++) {
+        if (!prog->is_const[r]) continue;
+        for (int i = 0; i < BB_BLOCK; i++) regs[r][i] = prog->consts[r];
+    }
+}
+
+#define BB_LOOP(expr) for (int i = 0; i < n; i++) d[i] = (expr)
+
+// Function to evaluate samples t0 .. t0 + n - 1 (n <= BB_BLOCK) into out.
+// Built twice, for AVX2 and plain x86-64, and picked when the program loads.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+__attribute__((target_clones("avx2", "default")))
+#endif
+void bb_run(const Program *prog, BbRegs regs, uint32_t t0, int n, uint8_t *out) {
+    for (int i = 0; i < n; i++) regs[R_T][i] = (int32_t)(t0 + (uint32_t)i);
+
+    for (int k = 0; k < prog->n_code; k++) {
+        const Insn *in = &prog->code[k];
+        int32_t *d = regs[in->dst];
+        const int32_t *a = regs[in->a], *b = regs[in->b], *c = regs[in->c];
+        switch ((OpCode)in->op) {
+            case OP_ADD: BB_LOOP((int32_t)((uint32_t)a[i] + (uint32_t)b[i])); break;
+            case OP_SUB: BB_LOOP((int32_t)((uint32_t)a[i] - (uint32_t)b[i])); break;
+            case OP_MUL: BB_LOOP((int32_t)((uint32_t)a[i] * (uint32_t)b[i])); break;
+            case OP_DIV: BB_LOOP(bb_div(a[i], b[i])); break;
+            case OP_MOD: BB_LOOP(bb_mod(a[i], b[i])); break;
+            case OP_AND: BB_LOOP(a[i] & b[i]); break;
+            case OP_OR: BB_LOOP(a[i] | b[i]); break;
+            case OP_XOR: BB_LOOP(a[i] ^ b[i]); break;
+            case OP_SHL: BB_LOOP((int32_t)((uint32_t)a[i] << (b[i] & 31))); break;
+            case OP_SHR: BB_LOOP(a[i] >> (b[i] & 31)); break;
+            case OP_LT: BB_LOOP(a[i] < b[i]); break;
+            case OP_LE: BB_LOOP(a[i] <= b[i]); break;
+            case OP_EQ: BB_LOOP(a[i] == b[i]); break;
+            case OP_NE: BB_LOOP(a[i] != b[i]); break;
+            case OP_LAND: BB_LOOP((a[i] != 0) & (b[i] != 0)); break;
+            case OP_LOR: BB_LOOP((a[i] | b[i]) != 0); break;
+            case OP_NEG: BB_LOOP((int32_t)(0u - (uint32_t)a[i])); break;
+            case OP_NOT: BB_LOOP(~a[i]); break;
+            case OP_LNOT: BB_LOOP(a[i] == 0); break;
+            case OP_SEL: BB_LOOP(a[i] ? b[i] : c[i]); break;
+            case OP_INDEX: {
+                const BbString *s = &prog->strings[in->b];
+                BB_LOOP((uint32_t)a[i] < (uint32_t)s->len ? (unsigned char)s->text[a[i]] : 0);
+                break;
+            }
+            default: break;
+        }
+    }
+
+    const int32_t *r = regs[prog->result];
+    for (int i = 0; i < n; i++) out[i] = (uint8_t)r[i];
+}
+
+/* ---- Benchmark against the hand-written generators ---- */
+
+// supersaw.c, as written there
+static uint8_t native_supersaw(unsigned int t) {
+    return (((t * 7) & 255) + ((int)(t * 7.03) & 255) + ((int)(t * 6.97) & 255)) / 3;
+}
+
+// supersaw.c in integers, as a formula and in C with the formula's semantics
+static const char *supersaw_formula = "((t*7&255)+(t*703/100&255)+(t*697/100&255))/3";
+
+static uint8_t native_supersaw_int(uint32_t t) {
+    int32_t a = (int32_t)(t * 7) & 255;
+    int32_t b = (int32_t)(t * 703) / 100 & 255;
+    int32_t c = (int32_t)(t * 697) / 100 & 255;
+    return (uint8_t)((a + b + c) / 3);
+}
+
+// supersaw_chord.c's chords, detune and base frequency, as rates in 1/1000
+static const float chord_ratios[3][4] = {
+    { 1.0, 1.25, 1.5, 1.75 },
+    { 1.0, 1.259921, 1.498307, 1.887749 },
+    { 1.0, 1.189207, 1.414214, 1.781797 },
+};
+static const float chord_detune[3] = { 1.0, 1.03, 0.97 };
+static int32_t chord_rate[3][4][3];
+
+static void build_chord_formula(char *buf, size_t size) {
+    size_t len = 0;
+    len += (size_t)snprintf(buf + len, size - len, "(");
+    for (int note = 0; note < 4; note++) {
+        len += (size_t)snprintf(buf + len, size - len, "%s(", note ? "+" : "");
+        for (int d = 0; d < 3; d++) {
+            for (int c = 0; c < 3; c++) {
+                chord_rate[c][note][d] = (int32_t)lrint(chord_ratios[c][note] * 7 * chord_detune[d] * 1000);
+            }
+            len += (size_t)snprintf(buf + len, size - len, "%s(t*(t/16000%%3==0?%d:t/16000%%3==1?%d:%d)/1000&255)",
+                                    d ? "+" : "", chord_rate[0][note][d], chord_rate[1][note][d], chord_rate[2][note][d]);
+        }
+        len += (size_t)snprintf(buf + len, size - len, ")/3");
+    }
+    snprintf(buf + len, size - len, ")/4");
+}
+
+static uint8_t native_chord_int(uint32_t t) {
+    int c = (int32_t)t / 16000 % 3;
+    int32_t sum = 0;
+    for (int note = 0; note < 4; note++) {
+        int32_t v = 0;
+        for (int d = 0; d < 3; d++) v += (int32_t)(t * (uint32_t)chord_rate[c][note][d]) / 1000 & 255;
+        sum += v / 3;
+    }
+    return (uint8_t)(sum / 4);
+}
+
+static const char *classic_formula = "t*((t>>12|t>>8)&63&t>>4)";
+
+static uint8_t native_classic(uint32_t t) {
+    int32_t s = (int32_t)t;
+    return (uint8_t)(int32_t)(t * (uint32_t)(((s >> 12 | s >> 8) & 63) & s >> 4));
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef uint8_t (*NativeFunc)(uint32_t t);
+
+static double time_native(NativeFunc f, uint8_t *out, long samples) {
+    double t0 = now_seconds();
+    for (long i = 0; i < samples; i++) out[i] = f((uint32_t)i);
+    return (now_seconds() - t0) * 1e9 / samples;
+}
+
+static double time_vm(const Program *prog, BbRegs regs, int block, uint8_t *out, long samples) {
+    double t0 = now_seconds();
+    for (long i = 0; i < samples; i += block) {
+        int n = samples - i < block ? (int)(samples - i) : block;
+        bb_run(prog, regs, (uint32_t)i, n, out + i);
+    }
+    return (now_seconds() - t0) * 1e9 / samples;
+}
+
+static uint8_t supersaw_float_adapter(uint32_t t) { return native_supersaw(t); }
+
+void run_bench(long samples) {
+    static char chord_formula[8192];
+    build_chord_formula(chord_formula, sizeof(chord_formula));
+    struct { const char *name; const char *formula; NativeFunc native; } cases[] = {
+        { "supersaw", supersaw_formula, native_supersaw_int },
+        { "supersaw_chord", chord_formula, native_chord_int },
+        { "classic", classic_formula, native_classic },
+    };
+    uint8_t *want = malloc((size_t)samples), *got = malloc((size_t)samples);
+    static BbRegs regs;
+    Program prog;
+
+    printf("%ld samples, ns/sample (C = integer rewrite of the program, VM = compiled formula)\n", samples);
+    printf("  supersaw.c as written (float)   C %6.2f\n", time_native(supersaw_float_adapter, want, samples));
+    for (int k = 0; k < 3; k++) {
+        if (bb_compile(&prog, cases[k].formula) != 0) continue;
+        bb_load(&prog, regs);
+        double c_ns = time_native(cases[k].native, want, samples);
+        double vm1_ns = time_vm(&prog, regs, 1, got, samples);
+        double vm_ns = time_vm(&prog, regs, BB_BLOCK, got, samples);
+        long diff = 0;
+        for (long i = 0; i < samples; i++) diff += want[i] != got[i];
+        printf("  %-14s %3d insns  C %6.2f  VM per sample %6.2f  VM block %6.2f  %s\n", cases[k].name,
+               prog.n_code, c_ns, vm1_ns, vm_ns, diff ? "MISMATCH" : "identical");
+    }
+
+    // How far the integer supersaw drifts from the float original
+    long diff = 0;
+    for (long i = 0; i < samples; i++) diff += native_supersaw((unsigned int)i) != native_supersaw_int((uint32_t)i);
+    printf("  supersaw integer formula differs from the float original in %ld samples\n", diff);
+    free(want);
+    free(got);
+}
+
+int main(int argc, char *argv[]) {
+    PcmFormat fmt = { .rate = 8000, .channels = 1, .bits = 8, .fixed_rate = true };
+    pcm_parse_args(&argc, argv, &fmt);
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        run_bench(argc > 2 ? atol(argv[2]) : 1 << 22);
+        return 0;
+    }
+    bool dump = argc > 1 && strcmp(argv[1], "--dump") == 0;
+    if (argc != 2 + dump) {
+        fprintf(stderr, "Usage: %s [format flags] 'formula'\n", argv[0]);
+        fprintf(stderr, "       %s --dump 'formula'\n", argv[0]);
+        fprintf(stderr, "       %s --bench [samples]\n", argv[0]);
+        fprintf(stderr, "Example: %s '%s'\n", argv[0], classic_formula);
+        return 1;
+    }
+
+    static Program prog;
+    static BbRegs regs;
+    if (bb_compile(&prog, argv[1 + dump]) != 0) return 1;
+    if (dump) {
+        bb_dump(&prog, stdout);
+        return 0;
+    }
+    bb_load(&prog, regs);
+
+    PcmOut out;
+    if (pcm_open(&out, STDOUT_FILENO, &fmt) != 0) return 1;
+    uint8_t block[BB_BLOCK];
+    for (uint32_t t = 0; pcm_more(&out); t += BB_BLOCK) {
+        bb_run(&prog, regs, t, BB_BLOCK, block);
+        for (int i = 0; i < BB_BLOCK && pcm_more(&out); i++) pcm_put_u8(&out, block[i]);
+    }
+    pcm_close(&out);
+    return 0;
+}
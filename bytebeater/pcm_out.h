@@ -0,0 +1,324 @@
+/*
+ * pcm_out.h - block-buffered PCM output shared by the bytebeater programs
+ *
+ * Samples are converted straight into large, page-aligned blocks, and a
+ * block goes out in a single write() once it is full. When the output is a
+ * pipe (| sox, | aplay), Linux builds vmsplice() the block's pages into the
+ * pipe rather than copying them. Two blocks, each the size of the pipe,
+ * take turns: once one has been spliced in, the pipe has drained the
+ * other, so it is safe to overwrite.
+ *
+ * Format flags, removed from argv by pcm_parse_args():
+ *   -c N            channels (mono output is copied to every channel)
+ *   -b 8|16|24|32   bits per sample: 8 is unsigned, the rest signed
+ *   -B              big-endian (default little)
+ *   -r HZ           sample rate the program renders at (refused by the
+ *                   fixed-rate bytebeats, whose samples are per tick)
+ *   -n FRAMES       stop after this many frames (default: the program's own length)
+ *   -o FILE.wav     write a WAV file instead of raw PCM on stdout (needs a length)
+ *
+ * WAV output skips the pipe altogether. The file is preallocated at its
+ * final size and mapped, and samples are converted straight into the
+ * mapping. The header is written once the length is known. The header
+ * reserves room for an RF64 ds64 chunk (as JUNK), so past 4 GB it is
+ * rewritten in place as RF64 instead of moving the data.
+ *
+ * Include this first: vmsplice() needs _GNU_SOURCE.
+ *
+ */
+#ifndef PCM_OUT_H
+#define PCM_OUT_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/uio.h>
+#endif
+
+#define PCM_BLOCK_BYTES (1 << 16)   // when not splicing
+#define PCM_ALIGN 4096             // whole pages, for vmsplice()
+#define WAV_HEADER_BYTES 80         // RIFF + JUNK/ds64 + fmt + data headers
+
+typedef struct {
+    int rate;
+    int channels;
+    int bits;                       // 8, 16, 24 or 32
+    bool big_endian;
+    uint64_t frames;                // 0 = no limit
+    const char* wav_path;           // -o: write a WAV file here instead
+    bool fixed_rate;                // samples don't depend on rate, so -r can't be honoured
+} PcmFormat;
+
+typedef struct {
+    PcmFormat fmt;
+    int fd;
+    int sample_bytes;
+    uint8_t* block[2];
+    int cur;
+    size_t size;                    // bytes per block, whole frames
+    size_t used;
+    bool splice;
+    uint64_t frames;                // frames written so far
+    bool failed;
+    uint8_t* map;                   // WAV output: the whole file, mapped
+    size_t map_len;
+} PcmOut;
+
+// Pulls the format flags out of argv, leaving the program's own arguments.
+static inline void pcm_parse_args(int* argc, char* argv[], PcmFormat* fmt) {
+    int kept = 1;
+    int rate = 0;
+    for (int i = 1; i < *argc; i++) {
+        const char* a = argv[i];
+        bool has_value = i + 1 < *argc;
+        if (strcmp(a, "-c") == 0 && has_value) fmt->channels = atoi(argv[++i]);
+        else if (strcmp(a, "-b") == 0 && has_value) fmt->bits = atoi(argv[++i]);
+        else if (strcmp(a, "-r") == 0 && has_value) rate = atoi(argv[++i]);
+        else if (strcmp(a, "-n") == 0 && has_value) fmt->frames = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(a, "-o") == 0 && has_value) fmt->wav_path = argv[++i];
+        else if (strcmp(a, "-B") == 0) fmt->big_endian = true;
+        else argv[kept++] = argv[i];
+    }
+    *argc = kept;
+    argv[kept] = NULL;
+    if (fmt->channels < 1) fmt->channels = 1;
+    // Relabelling the header would only change the pitch it plays back at.
+    if (rate && fmt->fixed_rate) fprintf(stderr, "This program renders at a fixed %d Hz, ignoring -r\n", fmt->rate);
+    else if (rate > 0) fmt->rate = rate;
+    if (fmt->bits != 8 && fmt->bits != 16 && fmt->bits != 24 && fmt->bits != 32) {
+        fprintf(stderr, "Unsupported sample size %d bits, using 16\n", fmt->bits);
+        fmt->bits = 16;
+    }
+    if (fmt->wav_path && fmt->big_endian) {
+        fprintf(stderr, "WAV data is little-endian, ignoring -B\n");
+        fmt->big_endian = false;
+    }
+}
+
+static inline void pcm_le16(uint8_t* p, uint32_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+static inline void pcm_le32(uint8_t* p, uint32_t v) { pcm_le16(p, v); pcm_le16(p + 2, v >> 16); }
+static inline void pcm_le64(uint8_t* p, uint64_t v) { pcm_le32(p, (uint32_t)v); pcm_le32(p + 4, (uint32_t)(v >> 32)); }
+
+// RIFF/WAVE header for data_bytes of PCM; RF64 once the sizes overflow 32 bits
+static inline void pcm_wav_header(uint8_t h[WAV_HEADER_BYTES], const PcmFormat* fmt, uint64_t data_bytes) {
+    uint64_t riff_bytes = WAV_HEADER_BYTES - 8 + data_bytes + (data_bytes & 1);
+    bool rf64 = riff_bytes > 0xffffffffu;
+    int block_align = fmt->channels * (fmt->bits / 8);
+
+    memset(h, 0, WAV_HEADER_BYTES);
+    memcpy(h, rf64 ? "RF64" : "RIFF", 4);
+    pcm_le32(h + 4, rf64 ? 0xffffffffu : (uint32_t)riff_bytes);
+    memcpy(h + 8, "WAVE", 4);
+
+    memcpy(h + 12, rf64 ? "ds64" : "JUNK", 4);
+    pcm_le32(h + 16, 28);
+    if (rf64) {
+        pcm_le64(h + 20, riff_bytes);
+        pcm_le64(h + 28, data_bytes);
+        pcm_le64(h + 36, data_bytes / block_align);
+    }
+
+    memcpy(h + 48, "fmt ", 4);
+    pcm_le32(h + 52, 16);
+    pcm_le16(h + 56, 1);                                    // integer PCM
+    pcm_le16(h + 58, (uint32_t)fmt->channels);
+    pcm_le32(h + 60, (uint32_t)fmt->rate);
+    pcm_le32(h + 64, (uint32_t)(fmt->rate * block_align));
+    pcm_le16(h + 68, (uint32_t)block_align);
+    pcm_le16(h + 70, (uint32_t)fmt->bits);
+
+    memcpy(h + 72, "data", 4);
+    pcm_le32(h + 76, rf64 ? 0xffffffffu : (uint32_t)data_bytes);
+}
+
+// Preallocates the WAV file and maps it; samples then land in the page cache
+// directly and pcm_close() writes the header.
+static inline int pcm_open_wav(PcmOut* o) {
+    if (o->fmt.frames == 0) {
+        fprintf(stderr, "WAV output needs a length: add -n FRAMES\n");
+        return -1;
+    }
+    o->fd = open(o->fmt.wav_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (o->fd < 0) {
+        perror(o->fmt.wav_path);
+        return -1;
+    }
+    uint64_t data_bytes = o->fmt.frames * (uint64_t)o->sample_bytes * o->fmt.channels;
+    o->map_len = (size_t)(WAV_HEADER_BYTES + data_bytes);
+    int err = posix_fallocate(o->fd, 0, (off_t)o->map_len);
+    if (err == EINVAL || err == EOPNOTSUPP) err = ftruncate(o->fd, (off_t)o->map_len) == 0 ? 0 : errno;
+    if (err != 0) {
+        fprintf(stderr, "%s: %s\n", o->fmt.wav_path, strerror(err));
+        close(o->fd);
+        return -1;
+    }
+    o->map = mmap(NULL, o->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, o->fd, 0);
+    if (o->map == MAP_FAILED) {
+        perror("mmap");
+        o->map = NULL;
+        close(o->fd);
+        return -1;
+    }
+    madvise(o->map, o->map_len, MADV_SEQUENTIAL);
+    pcm_wav_header(o->map, &o->fmt, data_bytes);
+    o->block[0] = o->map + WAV_HEADER_BYTES;
+    o->size = (size_t)data_bytes;
+    return 0;
+}
+
+static inline int pcm_open(PcmOut* o, int fd, const PcmFormat* fmt) {
+    memset(o, 0, sizeof(*o));
+    o->fmt = *fmt;
+    o->fd = fd;
+    o->sample_bytes = fmt->bits / 8;
+    size_t frame = (size_t)o->sample_bytes * fmt->channels;
+    o->size = PCM_BLOCK_BYTES;
+    if (fmt->wav_path) return pcm_open_wav(o);
+
+#if defined(__linux__) && defined(F_GETPIPE_SZ)
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        int pipe_size = fcntl(fd, F_GETPIPE_SZ);
+        if (pipe_size < PCM_BLOCK_BYTES) pipe_size = fcntl(fd, F_SETPIPE_SZ, PCM_BLOCK_BYTES);
+        if (pipe_size < 0) pipe_size = fcntl(fd, F_GETPIPE_SZ);
+        if (pipe_size > 0) {
+            o->size = (size_t)pipe_size;
+            o->splice = true;
+        }
+    }
+#endif
+    o->size -= o->size % frame;
+    for (int i = 0; i < 2; i++) {
+        if (posix_memalign((void**)&o->block[i], PCM_ALIGN, o->size) != 0) return -1;
+    }
+    return 0;
+}
+
+static inline bool pcm_write_all(int fd, const uint8_t* p, size_t n) {
+    while (n > 0) {
+        ssize_t put = write(fd, p, n);
+        if (put < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += put;
+        n -= (size_t)put;
+    }
+    return true;
+}
+
+static inline void pcm_flush(PcmOut* o) {
+    if (o->used == 0 || o->failed || o->map) return;
+    uint8_t* p = o->block[o->cur];
+    size_t n = o->used;
+#ifdef __linux__
+    if (o->splice) {
+        while (n > 0) {
+            struct iovec iov = { p, n };
+            ssize_t put = vmsplice(o->fd, &iov, 1, 0);
+            if (put < 0) {
+                if (errno == EINTR) continue;
+                o->splice = false;          // not a pipe after all: plain writes from here on
+                break;
+            }
+            p += put;
+            n -= (size_t)put;
+        }
+    }
+#endif
+    if (n > 0 && !pcm_write_all(o->fd, p, n)) o->failed = true;    // reader went away
+    o->used = 0;
+    if (o->splice) o->cur ^= 1;     // the pipe still holds this block's pages
+}
+
+static inline void pcm_store(PcmOut* o, uint8_t* p, int32_t s) {
+    // s is full scale 32-bit; keep the top bits
+    switch (o->sample_bytes) {
+        case 1:
+            p[0] = (uint8_t)((s >> 24) + 128);
+            break;
+        case 2:
+            if (o->fmt.big_endian) { p[0] = (uint8_t)(s >> 24); p[1] = (uint8_t)(s >> 16); }
+            else { p[0] = (uint8_t)(s >> 16); p[1] = (uint8_t)(s >> 24); }
+            break;
+        case 3:
+            if (o->fmt.big_endian) { p[0] = (uint8_t)(s >> 24); p[1] = (uint8_t)(s >> 16); p[2] = (uint8_t)(s >> 8); }
+            else { p[0] = (uint8_t)(s >> 8); p[1] = (uint8_t)(s >> 16); p[2] = (uint8_t)(s >> 24); }
+            break;
+        default:
+            if (o->fmt.big_endian) {
+                p[0] = (uint8_t)(s >> 24); p[1] = (uint8_t)(s >> 16); p[2] = (uint8_t)(s >> 8); p[3] = (uint8_t)s;
+            } else {
+                memcpy(p, &s, 4);
+            }
+            break;
+    }
+}
+
+// False once the frame limit is reached or the reader has gone away.
+static inline bool pcm_more(const PcmOut* o) {
+    return !o->failed && (o->fmt.frames == 0 || o->frames < o->fmt.frames);
+}
+
+// One frame from a full-scale 32-bit sample per channel
+static inline void pcm_put_frame(PcmOut* o, const int32_t* samples) {
+    if (o->used == o->size || (o->fmt.frames && o->frames == o->fmt.frames)) return;     // -n reached, the end of a WAV file, or a failed flush
+    uint8_t* p = o->block[o->cur] + o->used;
+    for (int c = 0; c < o->fmt.channels; c++, p += o->sample_bytes) pcm_store(o, p, samples[c]);
+    o->used += (size_t)o->sample_bytes * o->fmt.channels;
+    o->frames++;
+    if (o->used == o->size) pcm_flush(o);
+}
+
+// One mono sample, copied to every channel
+static inline void pcm_put(PcmOut* o, int32_t s) {
+    if (o->used == o->size || (o->fmt.frames && o->frames == o->fmt.frames)) return;
+    uint8_t* p = o->block[o->cur] + o->used;
+    if (o->fmt.channels == 1 && o->sample_bytes == 1) {
+        *p = (uint8_t)((s >> 24) + 128);    // the bytebeat case
+        o->used++;
+    } else {
+        for (int c = 0; c < o->fmt.channels; c++, p += o->sample_bytes) pcm_store(o, p, s);
+        o->used += (size_t)o->sample_bytes * o->fmt.channels;
+    }
+    o->frames++;
+    if (o->used == o->size) pcm_flush(o);
+}
+
+static inline void pcm_put_u8(PcmOut* o, uint8_t v) { pcm_put(o, (int32_t)((uint32_t)(v ^ 0x80) << 24)); }
+static inline void pcm_put_s16(PcmOut* o, int16_t v) { pcm_put(o, (int32_t)((uint32_t)(uint16_t)v << 16)); }
+
+static inline void pcm_close(PcmOut* o) {
+    if (o->map) {
+        // Trim to what was written (plus RIFF's pad byte) and finish the header
+        uint64_t data_bytes = o->used;
+        uint8_t h[WAV_HEADER_BYTES];
+        pcm_wav_header(h, &o->fmt, data_bytes);
+        munmap(o->map, o->map_len);
+        o->map = NULL;
+        o->block[0] = NULL;
+        if (ftruncate(o->fd, (off_t)(WAV_HEADER_BYTES + data_bytes + (data_bytes & 1))) != 0 ||
+            pwrite(o->fd, h, sizeof(h), 0) != (ssize_t)sizeof(h) || close(o->fd) != 0) {
+            perror(o->fmt.wav_path);
+        }
+        return;
+    }
+    pcm_flush(o);
+    free(o->block[0]);
+    free(o->block[1]);
+    o->block[0] = o->block[1] = NULL;
+}
+
+#endif // PCM_OUT_H
@@ -1,15 +1,21 @@
-#include <stdio.h>
+#include "pcm_out.h"
+
+int main(int argc, char *argv[]) {
+    PcmFormat fmt = { .rate = 8000, .channels = 1, .bits = 8, .fixed_rate = true };
+    pcm_parse_args(&argc, argv, &fmt);
+    PcmOut out;
+    if (pcm_open(&out, STDOUT_FILENO, &fmt) != 0) return 1;
 
-int main() {
     unsigned int t = 0; // Time step, an unsigned integer
-    while (1) {
-        putchar(
+    while (pcm_more(&out)) {
+        pcm_put_u8(&out,
             (
                 (((t * 7) & 255) + ((int)(t * 7.03) & 255) + ((int)(t * 6.97) & 255)) / 3
             )
         );
         t++;
     }
+    pcm_close(&out);
     return 0;
 }
 
@@ -1,4 +1,4 @@
-#include <stdio.h>
+#include "pcm_out.h"
 #include <math.h>
 
 // Define frequencies for a chord sequence (Debussy-inspired)
@@ -22,11 +22,16 @@ unsigned char supersaw(int t, float base_freq) {
     return value / num_detune;
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+    PcmFormat fmt = { .rate = 8000, .channels = 1, .bits = 8, .fixed_rate = true };
+    pcm_parse_args(&argc, argv, &fmt);
+    PcmOut out;
+    if (pcm_open(&out, STDOUT_FILENO, &fmt) != 0) return 1;
+
     unsigned int t = 0;
 
     // Play the chord sequence
-    while (1) {
+    while (pcm_more(&out)) {
         // Determine the current chord
         int chord_index = (t / chord_duration) % num_chords;
         float *chord = chord_sequence[chord_index];
@@ -43,11 +48,12 @@ int main() {
         combined_value /= 4;
 
         // Output the waveform
-        putchar(combined_value);
+        pcm_put_u8(&out, combined_value);
 
         t++;
     }
 
+    pcm_close(&out);
     return 0;
 }
 
@@ -1,10 +1,15 @@
 //bytebeat synthesis example
 
+#include "pcm_out.h" // Block-buffered output (format flags: see pcm_out.h)
 #include <math.h> // Include the math library for mathematical functions like pow()
-#include <stdio.h>
 
-int main()
+int main(int argc, char *argv[])
 {
+    PcmFormat fmt = { .rate = 8000, .channels = 1, .bits = 8, .fixed_rate = true };
+    pcm_parse_args(&argc, argv, &fmt);
+    PcmOut out;
+    if (pcm_open(&out, STDOUT_FILENO, &fmt) != 0) return 1;
+
     // Variable declarations
     int v; // Controls the position in the melody or audio pattern
     int i; // Iterates for sound synthesis in each audio sample
@@ -14,7 +19,7 @@ int main()
     int t; // Temporary storage for frequency or amplitude calculations
 
     // Outer infinite loop to generate continuous audio data
-    for (v = -1;;) {
+    for (v = -1; pcm_more(&out);) {
         // Inner loop: Generate 999 audio samples for the current note
         for (
             // Frequency calculation for the current note
@@ -23,7 +28,7 @@ int main()
                     (v & 64) / 21), // Adds an offset if the 7th bit of v is set
             i = 999; // Initialize the sample counter to 999 for each note
             i; // Continue while i > 0
-            putchar( // Output a single byte representing the audio signal
+            pcm_put_u8(&out, // Output a single byte representing the audio signal
                 128 + // Center the waveform at 128 for unsigned 8-bit audio
                 ((8191 & u) > i ? 0 : i / 8) - // Conditional amplitude modulation
                 ((8191 & (z += n)) * i-- >> 16) // Combine phase and sample index for waveform synthesis
@@ -37,6 +42,7 @@ int main()
                      n / 4); // Otherwise, set t to a quarter of the frequency
         }
     }
-    return 0; // End of program (unreachable due to infinite loop)
+    pcm_close(&out);
+    return 0; // End of program (reached when the -n frame limit is hit)
 }
 
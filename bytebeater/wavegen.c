@@ -1,16 +1,19 @@
+#include "pcm_out.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <math.h>
 #include <stdint.h>
 #include <string.h>
+#include <pthread.h>
 
 // Constants
 #define SAMPLE_RATE 44100  // 44.1 kHz sample rate
 #define DURATION 5         // Duration in seconds
 #define AMPLITUDE 32767    // Maximum amplitude for 16-bit audio
 #define FREQUENCY 440      // Frequency in Hz (for all waveforms)
-#define WAVETABLE_SIZE 512 // Length of the wavetable
+#define WAVETABLE_BITS 9
+#define WAVETABLE_SIZE (1 << WAVETABLE_BITS) // Length of the wavetable (512)
 
 
 // FM parameters (carrier and modulator frequencies and modulation index)
@@ -110,10 +113,859 @@ int16_t wavegen_select(double t, int wave_select) {
 }
 
 
+// Phase-accumulator oscillators. Each voice keeps a 32-bit phase that wraps
+// once per cycle and is advanced by a per-voice increment, so the frequency
+// can be changed on any call and precision never decays as time goes on
+// (sin(2 * M_PI * f * t) loses bits as t grows). Sines come from a table
+// with linear or cubic interpolation.
+#define OSC_TABLE_BITS 11
+#define OSC_TABLE_SIZE (1 << OSC_TABLE_BITS)
+#define OSC_FRAC_BITS (32 - OSC_TABLE_BITS)
+#define PHASE_PER_CYCLE 4294967296.0
+#define WAVEGEN_BLOCK 4096         // samples rendered per kernel call
+
+typedef enum {
+    INTERP_LINEAR = 0,
+    INTERP_CUBIC = 1
+} Interp;
+
+typedef struct {
+    uint32_t phase;
+    uint32_t inc;                   // phase step per sample
+    uint32_t mod_phase;             // FM modulator
+    uint32_t mod_inc;
+    float mod_depth;                // FM depth in cycles, |depth| < 1
+    int mip;                        // SAMPLE: band-limited level for this pitch
+    Interp interp;
+} Oscillator;
+
+// One full sine cycle plus a guard point before and two after, for cubic
+float osc_table[OSC_TABLE_SIZE + 3];
+
+// Band-limited copies of the 8-bit wavetable, as floats in [-1, 1], for the
+// SAMPLE oscillator. Level L keeps harmonics up to WAVETABLE_SIZE / 2 >> L,
+// so it stays below Nyquist while a sample steps over at most 2^L of the
+// original entries. Each level is resampled 4x (MIP_SIZE points) so linear
+// interpolation does not image the top harmonics back down. The levels sit
+// in one 64-byte aligned block with a guard point before and two after for
+// cubic, and entry 0 of each starts on a cache line.
+#define MIP_LEVELS WAVETABLE_BITS
+#define MIP_BITS (WAVETABLE_BITS + 2)
+#define MIP_SIZE (1 << MIP_BITS)
+#define MIP_FRAC_BITS (32 - MIP_BITS)
+#define MIP_PAD 16                 // floats before and after each level
+#define MIP_STRIDE (MIP_PAD + MIP_SIZE + MIP_PAD)
+
+float *mip_tables;
+
+static inline const float *mip_level(int level) {
+    return mip_tables + (size_t)level * MIP_STRIDE + MIP_PAD;
+}
+
+// Function to fill the sine table (once, at startup)
+void osc_init_table(void) {
+    for (int i = -1; i <= OSC_TABLE_SIZE + 1; i++) {
+        osc_table[i + 1] = (float)sin(2 * M_PI * i / OSC_TABLE_SIZE);
+    }
+}
+
+// In-place radix-2 FFT over n = 2^k points; the inverse is unscaled
+static void fft(double *re, double *im, int n, bool inverse) {
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j |= bit;
+        if (i < j) {
+            double t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    for (int len = 2; len <= n; len <<= 1) {
+        double ang = (inverse ? 2 : -2) * M_PI / len;
+        for (int i = 0; i < n; i += len) {
+            for (int k = 0; k < len / 2; k++) {
+                double wr = cos(ang * k), wi = sin(ang * k);
+                double *ar = &re[i + k], *ai = &im[i + k];
+                double br = re[i + k + len / 2] * wr - im[i + k + len / 2] * wi;
+                double bi = re[i + k + len / 2] * wi + im[i + k + len / 2] * wr;
+                re[i + k + len / 2] = *ar - br;
+                im[i + k + len / 2] = *ai - bi;
+                *ar += br;
+                *ai += bi;
+            }
+        }
+    }
+}
+
+// Function to build the mip levels from the 8-bit wavetable (once, at load):
+// one forward FFT, then per level keep the bins up to its harmonic limit,
+// zero-pad to MIP_SIZE and transform back. The table's Nyquist bin is
+// dropped everywhere; it has no phase to keep. Removing harmonics makes the
+// peaks ring past full scale, so every level shares one gain that keeps the
+// loudest within [-1, 1]; clipping would put back what was filtered out.
+int osc_init_mip_tables(const uint8_t wavetable[WAVETABLE_SIZE]) {
+    double spec_re[WAVETABLE_SIZE], spec_im[WAVETABLE_SIZE];
+    static double re[MIP_SIZE], im[MIP_SIZE];
+    double peak = 1.0;
+
+    free(mip_tables);
+    if (posix_memalign((void **)&mip_tables, 64, sizeof(float) * MIP_STRIDE * MIP_LEVELS) != 0) return -1;
+    for (int i = 0; i < WAVETABLE_SIZE; i++) {
+        spec_re[i] = wavetable[i] / 255.0 * 2.0 - 1.0;
+        spec_im[i] = 0;
+    }
+    fft(spec_re, spec_im, WAVETABLE_SIZE, false);
+
+    for (int level = 0; level < MIP_LEVELS; level++) {
+        int harmonics = (WAVETABLE_SIZE / 2) >> level;
+        memset(re, 0, sizeof(re));
+        memset(im, 0, sizeof(im));
+        for (int h = 0; h <= harmonics && h < WAVETABLE_SIZE / 2; h++) {
+            re[h] = spec_re[h];
+            im[h] = spec_im[h];
+            if (h == 0) continue;
+            re[MIP_SIZE - h] = spec_re[WAVETABLE_SIZE - h];
+            im[MIP_SIZE - h] = spec_im[WAVETABLE_SIZE - h];
+        }
+        fft(re, im, MIP_SIZE, true);
+
+        float *t = (float *)mip_level(level);
+        for (int i = -1; i <= MIP_SIZE + 1; i++) {
+            t[i] = (float)(re[(i + MIP_SIZE) % MIP_SIZE] / WAVETABLE_SIZE);
+            peak = fmax(peak, fabs(t[i]));
+        }
+    }
+    for (int level = 0; level < MIP_LEVELS; level++) {
+        float *t = (float *)mip_level(level);
+        for (int i = -1; i <= MIP_SIZE + 1; i++) t[i] = (float)(t[i] / peak);
+    }
+    return 0;
+}
+
+// Function to pick the level for a phase increment: the original table is
+// stepped through at inc / 2^(32 - WAVETABLE_BITS) entries per sample, and
+// level L is alias-free up to 2^L entries per sample
+int osc_mip_for(uint32_t inc) {
+    int level = 0;
+    while (level < MIP_LEVELS - 1 && inc > (uint32_t)1 << (32 - WAVETABLE_BITS + level)) level++;
+    return level;
+}
+
+uint32_t osc_increment(double hz, int sample_rate) {
+    double cycles = hz / sample_rate;
+    cycles -= floor(cycles);
+    return (uint32_t)(cycles * PHASE_PER_CYCLE + 0.5);
+}
+
+void osc_init(Oscillator *o, Interp interp) {
+    memset(o, 0, sizeof(*o));
+    o->interp = interp;
+}
+
+// Function to set the frequency; takes effect on the next sample
+void osc_set_freq(Oscillator *o, double hz, int sample_rate) {
+    o->inc = osc_increment(hz, sample_rate);
+    o->mip = osc_mip_for(o->inc);
+}
+
+// index is in radians and is held just under 2 * M_PI, a full cycle
+void osc_set_fm(Oscillator *o, double mod_hz, double index, int sample_rate) {
+    o->mod_inc = osc_increment(mod_hz, sample_rate);
+    o->mod_depth = (float)fmax(-0.999, fmin(0.999, index / (2 * M_PI)));
+}
+
+// Every scalar step below has a matching instruction sequence in the block
+// kernels further down, so both produce exactly the same samples (built with
+// -ffp-contract=off, so neither side gets fused multiply-adds).
+
+// Interpolated read of a table of 2^(32 - frac_bits) entries at a phase
+static inline float osc_lookup_in(const float *table, int frac_bits, uint32_t phase, Interp interp) {
+    const float *p = &table[phase >> frac_bits];
+    float x = (float)(int32_t)(phase & ((1u << frac_bits) - 1)) * (1.0f / (1u << frac_bits));
+    if (interp == INTERP_LINEAR) return p[0] + (p[1] - p[0]) * x;
+
+    // 4-point Catmull-Rom through p[-1], p[0], p[1], p[2]
+    float a = p[1] - p[-1];
+    float b = 2 * p[-1] - 5 * p[0] + 4 * p[1] - p[2];
+    float c = 3 * (p[0] - p[1]) + p[2] - p[-1];
+    return p[0] + 0.5f * x * (a + x * (b + x * c));
+}
+
+// Sine of a phase, in [-1, 1]
+static inline float osc_lookup(uint32_t phase, Interp interp) {
+    return osc_lookup_in(osc_table + 1, OSC_FRAC_BITS, phase, interp);
+}
+
+// Cubic can overshoot full scale slightly, so saturate like packs_epi32 does
+static inline int16_t osc_to_pcm(float v) {
+    long s = lrintf(v * AMPLITUDE);
+    return (int16_t)(s > INT16_MAX ? INT16_MAX : s < INT16_MIN ? INT16_MIN : s);
+}
+
+static inline float osc_square_at(uint32_t phase) {
+    return phase < 0x80000000u ? 1.0f : -1.0f;
+}
+
+// Same shape as triangle_wave(): -1 at phase 0, +1 at half a cycle
+static inline float osc_triangle_at(uint32_t phase) {
+    float p = (float)(int32_t)(phase >> 1) * (1.0f / 2147483648.0f);
+    return 1.0f - 4.0f * fabsf(p - 0.5f);
+}
+
+// The modulator bends the carrier's phase by up to mod_depth cycles
+static inline uint32_t osc_fm_offset(float depth, uint32_t mod_phase, Interp interp) {
+    float cycles = depth * osc_lookup(mod_phase, interp);
+    return (uint32_t)(int32_t)lrintf(cycles * 2147483648.0f) << 1;
+}
+
+int16_t osc_sine(Oscillator *o) {
+    int16_t s = osc_to_pcm(osc_lookup(o->phase, o->interp));
+    o->phase += o->inc;
+    return s;
+}
+
+int16_t osc_square(Oscillator *o) {
+    int16_t s = osc_to_pcm(osc_square_at(o->phase));
+    o->phase += o->inc;
+    return s;
+}
+
+int16_t osc_triangle(Oscillator *o) {
+    int16_t s = osc_to_pcm(osc_triangle_at(o->phase));
+    o->phase += o->inc;
+    return s;
+}
+
+int16_t osc_fm(Oscillator *o) {
+    uint32_t offset = osc_fm_offset(o->mod_depth, o->mod_phase, o->interp);
+    int16_t s = osc_to_pcm(osc_lookup(o->phase + offset, o->interp));
+    o->phase += o->inc;
+    o->mod_phase += o->mod_inc;
+    return s;
+}
+
+// The wavetable at any pitch, from the level that cannot alias there
+int16_t osc_sample(Oscillator *o) {
+    int16_t s = osc_to_pcm(osc_lookup_in(mip_level(o->mip), MIP_FRAC_BITS, o->phase, o->interp));
+    o->phase += o->inc;
+    return s;
+}
+
+// Oscillator counterpart of wavegen_select()
+int16_t osc_select(Oscillator *o, WaveType wave) {
+    switch (wave) {
+        case SINE:
+            return osc_sine(o);
+        case SQUARE:
+            return osc_square(o);
+        case FM:
+            return osc_fm(o);
+        case SAMPLE:
+            return osc_sample(o);
+        case TRIANGLE:
+        default:
+            return osc_triangle(o);
+    }
+}
+
+
+// Block kernels: fill out[0..n) and advance the oscillator as n calls to
+// osc_select() would. The vector versions run several phases side by side,
+// 8 samples per loop with SSE2 and 16 with AVX2 and AVX-512. Each converts
+// to int16 with saturation while the samples are still in registers, and
+// leaves the last few samples to the scalar code.
+typedef void (*RenderKernel)(Oscillator *o, WaveType wave, int16_t *out, int n);
+
+void render_scalar(Oscillator *o, WaveType wave, int16_t *out, int n) {
+    for (int i = 0; i < n; i++) out[i] = osc_select(o, wave);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define SIMD_TARGET_SSE2 __attribute__((target("sse2")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#define SIMD_TARGET_AVX512 __attribute__((target("avx512f")))
+
+// SSE2 has no gather, so table reads go through the stack
+SIMD_TARGET_SSE2 static inline __m128 sse2_gather(const float *base, __m128i idx, int offset) {
+    int32_t i[4] __attribute__((aligned(16)));
+    _mm_store_si128((__m128i *)i, idx);
+    return _mm_setr_ps(base[i[0] + offset], base[i[1] + offset], base[i[2] + offset], base[i[3] + offset]);
+}
+
+SIMD_TARGET_SSE2 static inline __m128 sse2_lookup_in(const float *t, int frac_bits, __m128i ph, Interp interp) {
+    __m128i idx = _mm_srli_epi32(ph, frac_bits);
+    __m128 x = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(ph, _mm_set1_epi32((int32_t)((1u << frac_bits) - 1)))), _mm_set1_ps(1.0f / (1u << frac_bits)));
+    __m128 p0 = sse2_gather(t, idx, 0), p1 = sse2_gather(t, idx, 1);
+    if (interp == INTERP_LINEAR) return _mm_add_ps(p0, _mm_mul_ps(_mm_sub_ps(p1, p0), x));
+
+    __m128 pm = sse2_gather(t, idx, -1), p2 = sse2_gather(t, idx, 2);
+    __m128 a = _mm_sub_ps(p1, pm);
+    __m128 b = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2), pm), _mm_mul_ps(_mm_set1_ps(5), p0)),
+                                     _mm_mul_ps(_mm_set1_ps(4), p1)), p2);
+    __m128 c = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(3), _mm_sub_ps(p0, p1)), p2), pm);
+    __m128 poly = _mm_add_ps(a, _mm_mul_ps(x, _mm_add_ps(b, _mm_mul_ps(x, c))));
+    return _mm_add_ps(p0, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), x), poly));
+}
+
+SIMD_TARGET_SSE2 static inline __m128 sse2_lookup(__m128i ph, Interp interp) {
+    return sse2_lookup_in(osc_table + 1, OSC_FRAC_BITS, ph, interp);
+}
+
+SIMD_TARGET_SSE2 static inline __m128 sse2_wave(const Oscillator *o, WaveType wave, __m128i ph, __m128i mph) {
+    __m128i sign = _mm_set1_epi32((int32_t)0x80000000u);
+    switch (wave) {
+        case SINE:
+            return sse2_lookup(ph, o->interp);
+        case SQUARE:
+            return _mm_or_ps(_mm_set1_ps(1.0f), _mm_castsi128_ps(_mm_and_si128(ph, sign)));
+        case FM: {
+            __m128 cycles = _mm_mul_ps(_mm_set1_ps(o->mod_depth), sse2_lookup(mph, o->interp));
+            __m128i offset = _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(cycles, _mm_set1_ps(2147483648.0f))), 1);
+            return sse2_lookup(_mm_add_epi32(ph, offset), o->interp);
+        }
+        case SAMPLE:
+            return sse2_lookup_in(mip_level(o->mip), MIP_FRAC_BITS, ph, o->interp);
+        case TRIANGLE:
+        default: {
+            __m128 p = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(ph, 1)), _mm_set1_ps(1.0f / 2147483648.0f));
+            __m128 dist = _mm_andnot_ps(_mm_castsi128_ps(sign), _mm_sub_ps(p, _mm_set1_ps(0.5f)));
+            return _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(4.0f), dist));
+        }
+    }
+}
+
+SIMD_TARGET_SSE2 static void render_sse2(Oscillator *o, WaveType wave, int16_t *out, int n) {
+    uint32_t inc = o->inc, minc = o->mod_inc;
+    __m128i ph = _mm_setr_epi32((int32_t)o->phase, (int32_t)(o->phase + inc),
+                                (int32_t)(o->phase + 2 * inc), (int32_t)(o->phase + 3 * inc));
+    __m128i mph = _mm_setr_epi32((int32_t)o->mod_phase, (int32_t)(o->mod_phase + minc),
+                                 (int32_t)(o->mod_phase + 2 * minc), (int32_t)(o->mod_phase + 3 * minc));
+    __m128i step = _mm_set1_epi32((int32_t)(4 * inc)), mstep = _mm_set1_epi32((int32_t)(4 * minc));
+    __m128 amp = _mm_set1_ps(AMPLITUDE);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 lo = sse2_wave(o, wave, ph, mph);
+        ph = _mm_add_epi32(ph, step);
+        mph = _mm_add_epi32(mph, mstep);
+        __m128 hi = sse2_wave(o, wave, ph, mph);
+        ph = _mm_add_epi32(ph, step);
+        mph = _mm_add_epi32(mph, mstep);
+        __m128i pcm = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(lo, amp)), _mm_cvtps_epi32(_mm_mul_ps(hi, amp)));
+        _mm_storeu_si128((__m128i *)(out + i), pcm);
+    }
+    o->phase += (uint32_t)i * inc;
+    if (wave == FM) o->mod_phase += (uint32_t)i * minc;
+    render_scalar(o, wave, out + i, n - i);
+}
+
+SIMD_TARGET_AVX2 static inline __m256 avx2_lookup_in(const float *t, int frac_bits, __m256i ph, Interp interp) {
+    __m256i idx = _mm256_srli_epi32(ph, frac_bits);
+    __m256 x = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(ph, _mm256_set1_epi32((int32_t)((1u << frac_bits) - 1)))), _mm256_set1_ps(1.0f / (1u << frac_bits)));
+    __m256 p0 = _mm256_i32gather_ps(t, idx, 4), p1 = _mm256_i32gather_ps(t + 1, idx, 4);
+    if (interp == INTERP_LINEAR) return _mm256_add_ps(p0, _mm256_mul_ps(_mm256_sub_ps(p1, p0), x));
+
+    __m256 pm = _mm256_i32gather_ps(t - 1, idx, 4), p2 = _mm256_i32gather_ps(t + 2, idx, 4);
+    __m256 a = _mm256_sub_ps(p1, pm);
+    __m256 b = _mm256_sub_ps(_mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(2), pm), _mm256_mul_ps(_mm256_set1_ps(5), p0)),
+                                           _mm256_mul_ps(_mm256_set1_ps(4), p1)), p2);
+    __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(3), _mm256_sub_ps(p0, p1)), p2), pm);
+    __m256 poly = _mm256_add_ps(a, _mm256_mul_ps(x, _mm256_add_ps(b, _mm256_mul_ps(x, c))));
+    return _mm256_add_ps(p0, _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), x), poly));
+}
+
+SIMD_TARGET_AVX2 static inline __m256 avx2_lookup(__m256i ph, Interp interp) {
+    return avx2_lookup_in(osc_table + 1, OSC_FRAC_BITS, ph, interp);
+}
+
+SIMD_TARGET_AVX2 static inline __m256 avx2_wave(const Oscillator *o, WaveType wave, __m256i ph, __m256i mph) {
+    __m256i sign = _mm256_set1_epi32((int32_t)0x80000000u);
+    switch (wave) {
+        case SINE:
+            return avx2_lookup(ph, o->interp);
+        case SQUARE:
+            return _mm256_or_ps(_mm256_set1_ps(1.0f), _mm256_castsi256_ps(_mm256_and_si256(ph, sign)));
+        case FM: {
+            __m256 cycles = _mm256_mul_ps(_mm256_set1_ps(o->mod_depth), avx2_lookup(mph, o->interp));
+            __m256i offset = _mm256_slli_epi32(_mm256_cvtps_epi32(_mm256_mul_ps(cycles, _mm256_set1_ps(2147483648.0f))), 1);
+            return avx2_lookup(_mm256_add_epi32(ph, offset), o->interp);
+        }
+        case SAMPLE:
+            return avx2_lookup_in(mip_level(o->mip), MIP_FRAC_BITS, ph, o->interp);
+        case TRIANGLE:
+        default: {
+            __m256 p = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(ph, 1)), _mm256_set1_ps(1.0f / 2147483648.0f));
+            __m256 dist = _mm256_andnot_ps(_mm256_castsi256_ps(sign), _mm256_sub_ps(p, _mm256_set1_ps(0.5f)));
+            return _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(4.0f), dist));
+        }
+    }
+}
+
+SIMD_TARGET_AVX2 static void render_avx2(Oscillator *o, WaveType wave, int16_t *out, int n) {
+    uint32_t inc = o->inc, minc = o->mod_inc;
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i ph = _mm256_add_epi32(_mm256_set1_epi32((int32_t)o->phase), _mm256_mullo_epi32(lane, _mm256_set1_epi32((int32_t)inc)));
+    __m256i mph = _mm256_add_epi32(_mm256_set1_epi32((int32_t)o->mod_phase), _mm256_mullo_epi32(lane, _mm256_set1_epi32((int32_t)minc)));
+    __m256i step = _mm256_set1_epi32((int32_t)(8 * inc)), mstep = _mm256_set1_epi32((int32_t)(8 * minc));
+    __m256 amp = _mm256_set1_ps(AMPLITUDE);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 lo = avx2_wave(o, wave, ph, mph);
+        ph = _mm256_add_epi32(ph, step);
+        mph = _mm256_add_epi32(mph, mstep);
+        __m256 hi = avx2_wave(o, wave, ph, mph);
+        ph = _mm256_add_epi32(ph, step);
+        mph = _mm256_add_epi32(mph, mstep);
+
+        // packs works within 128-bit halves; put the quarters back in order
+        __m256i pcm = _mm256_packs_epi32(_mm256_cvtps_epi32(_mm256_mul_ps(lo, amp)), _mm256_cvtps_epi32(_mm256_mul_ps(hi, amp)));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(pcm, 0xd8));
+    }
+    o->phase += (uint32_t)i * inc;
+    if (wave == FM) o->mod_phase += (uint32_t)i * minc;
+    render_scalar(o, wave, out + i, n - i);
+}
+
+SIMD_TARGET_AVX512 static inline __m512 avx512_lookup_in(const float *t, int frac_bits, __m512i ph, Interp interp) {
+    __m512i idx = _mm512_srli_epi32(ph, frac_bits);
+    __m512 x = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_and_si512(ph, _mm512_set1_epi32((int32_t)((1u << frac_bits) - 1)))), _mm512_set1_ps(1.0f / (1u << frac_bits)));
+    __m512 p0 = _mm512_i32gather_ps(idx, t, 4), p1 = _mm512_i32gather_ps(idx, t + 1, 4);
+    if (interp == INTERP_LINEAR) return _mm512_add_ps(p0, _mm512_mul_ps(_mm512_sub_ps(p1, p0), x));
+
+    __m512 pm = _mm512_i32gather_ps(idx, t - 1, 4), p2 = _mm512_i32gather_ps(idx, t + 2, 4);
+    __m512 a = _mm512_sub_ps(p1, pm);
+    __m512 b = _mm512_sub_ps(_mm512_add_ps(_mm512_sub_ps(_mm512_mul_ps(_mm512_set1_ps(2), pm), _mm512_mul_ps(_mm512_set1_ps(5), p0)),
+                                           _mm512_mul_ps(_mm512_set1_ps(4), p1)), p2);
+    __m512 c = _mm512_sub_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(3), _mm512_sub_ps(p0, p1)), p2), pm);
+    __m512 poly = _mm512_add_ps(a, _mm512_mul_ps(x, _mm512_add_ps(b, _mm512_mul_ps(x, c))));
+    return _mm512_add_ps(p0, _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(0.5f), x), poly));
+}
+
+SIMD_TARGET_AVX512 static inline __m512 avx512_lookup(__m512i ph, Interp interp) {
+    return avx512_lookup_in(osc_table + 1, OSC_FRAC_BITS, ph, interp);
+}
+
+SIMD_TARGET_AVX512 static inline __m512 avx512_wave(const Oscillator *o, WaveType wave, __m512i ph, __m512i mph) {
+    __m512i sign = _mm512_set1_epi32((int32_t)0x80000000u);
+    switch (wave) {
+        case SINE:
+            return avx512_lookup(ph, o->interp);
+        case SQUARE:
+            return _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(_mm512_set1_ps(1.0f)), _mm512_and_si512(ph, sign)));
+        case FM: {
+            __m512 cycles = _mm512_mul_ps(_mm512_set1_ps(o->mod_depth), avx512_lookup(mph, o->interp));
+            __m512i offset = _mm512_slli_epi32(_mm512_cvtps_epi32(_mm512_mul_ps(cycles, _mm512_set1_ps(2147483648.0f))), 1);
+            return avx512_lookup(_mm512_add_epi32(ph, offset), o->interp);
+        }
+        case SAMPLE:
+            return avx512_lookup_in(mip_level(o->mip), MIP_FRAC_BITS, ph, o->interp);
+        case TRIANGLE:
+        default: {
+            __m512 p = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_srli_epi32(ph, 1)), _mm512_set1_ps(1.0f / 2147483648.0f));
+            __m512i dist = _mm512_andnot_si512(sign, _mm512_castps_si512(_mm512_sub_ps(p, _mm512_set1_ps(0.5f))));
+            return _mm512_sub_ps(_mm512_set1_ps(1.0f), _mm512_mul_ps(_mm512_set1_ps(4.0f), _mm512_castsi512_ps(dist)));
+        }
+    }
+}
+
+SIMD_TARGET_AVX512 static void render_avx512(Oscillator *o, WaveType wave, int16_t *out, int n) {
+    uint32_t inc = o->inc, minc = o->mod_inc;
+    __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m512i ph = _mm512_add_epi32(_mm512_set1_epi32((int32_t)o->phase), _mm512_mullo_epi32(lane, _mm512_set1_epi32((int32_t)inc)));
+    __m512i mph = _mm512_add_epi32(_mm512_set1_epi32((int32_t)o->mod_phase), _mm512_mullo_epi32(lane, _mm512_set1_epi32((int32_t)minc)));
+    __m512i step = _mm512_set1_epi32((int32_t)(16 * inc)), mstep = _mm512_set1_epi32((int32_t)(16 * minc));
+    __m512 amp = _mm512_set1_ps(AMPLITUDE);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 v = avx512_wave(o, wave, ph, mph);
+        ph = _mm512_add_epi32(ph, step);
+        mph = _mm512_add_epi32(mph, mstep);
+        _mm256_storeu_si256((__m256i *)(out + i), _mm512_cvtsepi32_epi16(_mm512_cvtps_epi32(_mm512_mul_ps(v, amp))));
+    }
+    o->phase += (uint32_t)i * inc;
+    if (wave == FM) o->mod_phase += (uint32_t)i * minc;
+    render_scalar(o, wave, out + i, n - i);
+}
+#endif
+
+typedef struct {
+    const char *name;
+    RenderKernel render;
+} KernelInfo;
+
+static const KernelInfo kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    { "avx512", render_avx512 },
+    { "avx2", render_avx2 },
+    { "sse2", render_sse2 },
+#endif
+    { "scalar", render_scalar },
+};
+#define NUM_KERNELS (int)(sizeof(kernels) / sizeof(kernels[0]))
+
+// Function to ask cpuid (through the compiler's builtin, which also checks
+// that the OS saves the wider registers) whether a kernel can run here
+bool kernel_supported(const KernelInfo *k) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (k->render == render_avx512) return __builtin_cpu_supports("avx512f");
+    if (k->render == render_avx2) return __builtin_cpu_supports("avx2");
+    if (k->render == render_sse2) return __builtin_cpu_supports("sse2");
+#endif
+    return true;
+}
+
+// Function to pick the widest supported kernel, or the one named by -k
+const KernelInfo *pick_kernel(const char *name) {
+    for (int i = 0; i < NUM_KERNELS; i++) {
+        if (name && strcmp(name, kernels[i].name) != 0) continue;
+        if (kernel_supported(&kernels[i])) return &kernels[i];
+        fprintf(stderr, "Kernel %s is not supported on this CPU\n", name);
+        break;
+    }
+    if (name) fprintf(stderr, "Using the best available kernel instead of %s\n", name);
+    for (int i = 0; i < NUM_KERNELS; i++) {
+        if (kernel_supported(&kernels[i])) return &kernels[i];
+    }
+    return &kernels[NUM_KERNELS - 1];
+}
+
+// Function to check every supported kernel against the scalar path over odd
+// block lengths, several pitches and both interpolations; returns mismatches
+long check_kernels(bool verbose) {
+    static const WaveType waves[] = { SINE, SQUARE, TRIANGLE, FM, SAMPLE };
+    static const char *wave_names[] = { "sine", "square", "triangle", "fm", "sample" };
+    static const double pitches[] = { 27.5, 440.0, 3520.0, 19999.0, 44100.0 / 3 };
+    enum { CHECK_SAMPLES = 48000 };
+    static int16_t want[CHECK_SAMPLES], got[CHECK_SAMPLES];
+    long total = 0;
+
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        if (kernels[k].render == render_scalar || !kernel_supported(&kernels[k])) continue;
+        for (int w = 0; w < 5; w++) {
+            long bad = 0;
+            int max_diff = 0;
+            for (int interp = INTERP_LINEAR; interp <= INTERP_CUBIC; interp++) {
+                for (int p = 0; p < 5; p++) {
+                    Oscillator a, b;
+                    osc_init(&a, (Interp)interp);
+                    osc_set_freq(&a, pitches[p], SAMPLE_RATE);
+                    osc_set_fm(&a, pitches[p] / 2, modulation_index, SAMPLE_RATE);
+                    a.phase = a.mod_phase = 0x9e3779b9u * (uint32_t)(p + 1);
+                    b = a;
+                    render_scalar(&a, waves[w], want, CHECK_SAMPLES);
+                    for (int done = 0, len = 1; done < CHECK_SAMPLES; done += len, len = len * 3 + 1) {
+                        if (len > CHECK_SAMPLES - done) len = CHECK_SAMPLES - done;
+                        kernels[k].render(&b, waves[w], got + done, len);
+                    }
+                    if (a.phase != b.phase || a.mod_phase != b.mod_phase) bad++;
+                    for (int i = 0; i < CHECK_SAMPLES; i++) {
+                        int d = abs(want[i] - got[i]);
+                        if (d > max_diff) max_diff = d;
+                        if (d) bad++;
+                    }
+                }
+            }
+            if (verbose || bad) {
+                printf("  %-6s %-8s vs scalar: %s (max difference %d)\n", kernels[k].name, wave_names[w],
+                       bad ? "MISMATCH" : "identical", max_diff);
+            }
+            total += bad;
+        }
+    }
+    return total;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Function to measure SAMPLE aliasing: render one second at a 65536 Hz rate,
+// so every harmonic of an integer pitch lands on its own FFT bin, and return
+// the energy outside those bins relative to the total, in dB. level forces
+// a mip level (0 plays every harmonic, as the raw table would), -1 picks it
+double measure_alias(double hz, int level, Interp interp) {
+    enum { N = 65536 };
+    double *re = malloc(sizeof(double) * N), *im = malloc(sizeof(double) * N);
+    Oscillator o;
+    osc_init(&o, interp);
+    osc_set_freq(&o, hz, N);
+    if (level >= 0) o.mip = level;
+    for (int i = 0; i < N; i++) {
+        re[i] = osc_sample(&o);
+        im[i] = 0;
+    }
+    fft(re, im, N, false);
+    double total = 0, alias = 0;
+    for (int k = 1; k < N / 2; k++) {
+        double e = re[k] * re[k] + im[k] * im[k];
+        total += e;
+        if (k % (int)hz != 0) alias += e;
+    }
+    free(re);
+    free(im);
+    return 10 * log10(alias / total + 1e-30);
+}
+
+// Function to compare the oscillators against the sin(2 * M_PI * f * t) path:
+// speed, and error in 16-bit steps against an exact reference
+void run_osc_bench(long samples) {
+    volatile int32_t sink = 0;
+    double t0, ref_s, lin_s, cub_s;
+
+    t0 = now_seconds();
+    for (long i = 0; i < samples; i++) sink += wavegen_sine((double)i / SAMPLE_RATE);
+    ref_s = now_seconds() - t0;
+
+    Oscillator lin, cub;
+    osc_init(&lin, INTERP_LINEAR);
+    osc_init(&cub, INTERP_CUBIC);
+    osc_set_freq(&lin, FREQUENCY, SAMPLE_RATE);
+    osc_set_freq(&cub, FREQUENCY, SAMPLE_RATE);
+    t0 = now_seconds();
+    for (long i = 0; i < samples; i++) sink += osc_sine(&lin);
+    lin_s = now_seconds() - t0;
+    t0 = now_seconds();
+    for (long i = 0; i < samples; i++) sink += osc_sine(&cub);
+    cub_s = now_seconds() - t0;
+
+    printf("%ld samples of a %d Hz sine:\n", samples, FREQUENCY);
+    printf("  sin(2*pi*f*t)     %6.2f ns/sample\n", ref_s * 1e9 / samples);
+    printf("  phase acc, linear %6.2f ns/sample (%.1fx)\n", lin_s * 1e9 / samples, ref_s / lin_s);
+    printf("  phase acc, cubic  %6.2f ns/sample (%.1fx)\n", cub_s * 1e9 / samples, ref_s / cub_s);
+
+    // Interpolation error: each oscillator against the exact sine of its own phase
+    double lin_err = 0, cub_err = 0;
+    uint32_t phase = 0x12345u;
+    for (long i = 0; i < 1000000; i++, phase += 2654435761u) {
+        double exact = AMPLITUDE * sin(2 * M_PI * phase / PHASE_PER_CYCLE);
+        lin_err = fmax(lin_err, fabs(AMPLITUDE * osc_lookup(phase, INTERP_LINEAR) - exact));
+        cub_err = fmax(cub_err, fabs(AMPLITUDE * osc_lookup(phase, INTERP_CUBIC) - exact));
+    }
+    printf("  max error, linear %.3f LSB, cubic %.3f LSB\n", lin_err, cub_err);
+
+    // The sin(t) path against exact phase, f * n mod rate, as t grows
+    for (double start = 0; start <= 86400.0 * 400; start = start ? start * 30 : 3600) {
+        double err = 0;
+        uint64_t n0 = (uint64_t)(start * SAMPLE_RATE);
+        for (uint64_t n = n0; n < n0 + SAMPLE_RATE; n++) {
+            double exact = AMPLITUDE * sin(2 * M_PI * (double)((n * FREQUENCY) % SAMPLE_RATE) / SAMPLE_RATE);
+            err = fmax(err, fabs(AMPLITUDE * sin(2 * M_PI * FREQUENCY * ((double)n / SAMPLE_RATE)) - exact));
+        }
+        printf("  sin(t) path error at t = %8.0f s: %.3f LSB\n", start, err);
+    }
+    double actual = lin.inc * (double)SAMPLE_RATE / PHASE_PER_CYCLE;
+    printf("  phase acc pitch error %.2e Hz, error does not grow with t\n", actual - FREQUENCY);
+
+    // Block kernels, a WAVEGEN_BLOCK at a time as main() renders
+    static const WaveType waves[] = { SINE, SQUARE, TRIANGLE, FM, SAMPLE };
+    static int16_t block[WAVEGEN_BLOCK];
+    printf("Block kernels, ns/sample (linear):\n  %-6s %8s %8s %8s %8s %8s\n",
+           "", "sine", "square", "triangle", "fm", "sample");
+    for (int k = NUM_KERNELS - 1; k >= 0; k--) {
+        if (!kernel_supported(&kernels[k])) continue;
+        printf("  %-6s", kernels[k].name);
+        for (int w = 0; w < 5; w++) {
+            Oscillator o;
+            osc_init(&o, INTERP_LINEAR);
+            osc_set_freq(&o, FREQUENCY, SAMPLE_RATE);
+            osc_set_fm(&o, mod_freq, modulation_index, SAMPLE_RATE);
+            t0 = now_seconds();
+            for (long done = 0; done < samples; done += WAVEGEN_BLOCK) {
+                kernels[k].render(&o, waves[w], block, WAVEGEN_BLOCK);
+                sink += block[done % WAVEGEN_BLOCK];
+            }
+            printf(" %8.2f", (now_seconds() - t0) * 1e9 / samples);
+        }
+        printf("\n");
+    }
+    check_kernels(true);
+
+    printf("SAMPLE aliasing, energy off the harmonics:\n");
+    for (int hz = 55; hz <= 7040; hz *= 4) {
+        printf("  %5d Hz: level 0 only %6.1f dB, level %d: linear %6.1f dB, cubic %6.1f dB\n", hz,
+               measure_alias(hz, 0, INTERP_LINEAR), osc_mip_for(osc_increment(hz, 65536)),
+               measure_alias(hz, -1, INTERP_LINEAR), measure_alias(hz, -1, INTERP_CUBIC));
+    }
+}
+
+
+// Offline rendering. Every oscillator's phase at sample n is its phase at 0
+// plus n * inc (mod 2^32), so any stretch of the timeline can be rendered on
+// its own and still join up exactly with its neighbours. A RenderJob holds
+// the oscillators at sample 0; render_range() seeks them to its start.
+#define MAX_VOICES 64
+#define VOICE_DETUNE_CENTS 7.0     // between neighbouring voices
+#define RENDER_CHUNK 65536         // samples per thread-pool work item
+
+typedef struct {
+    WaveType wave;
+    RenderKernel render;
+    bool use_sin;
+    int rate;
+    int voices;
+    Oscillator osc[MAX_VOICES];
+} RenderJob;
+
+// Function to set up `voices` oscillators spread evenly around freq in pitch
+// and start phase, so a stack of them beats like a supersaw
+void render_job_init(RenderJob *job, WaveType wave, double freq, int voices, Interp interp, int rate) {
+    memset(job, 0, sizeof(*job));
+    job->wave = wave;
+    job->rate = rate;
+    job->voices = voices < 1 ? 1 : voices > MAX_VOICES ? MAX_VOICES : voices;
+    for (int v = 0; v < job->voices; v++) {
+        double f = freq * pow(2.0, (v - (job->voices - 1) / 2.0) * VOICE_DETUNE_CENTS / 1200.0);
+        Oscillator *o = &job->osc[v];
+        osc_init(o, interp);
+        osc_set_freq(o, wave == FM ? f * carrier_freq / FREQUENCY : f, rate);
+        osc_set_fm(o, f * mod_freq / FREQUENCY, modulation_index, rate);
+        o->phase = o->mod_phase = v ? 0x9e3779b9u * (uint32_t)v : 0;
+    }
+}
+
+// Function to render samples [start, start + n) of a job, voices mixed down
+void render_range(const RenderJob *job, uint64_t start, int16_t *out, int n) {
+    int16_t voice[WAVEGEN_BLOCK];
+    int32_t mix[WAVEGEN_BLOCK];
+
+    for (int done = 0; done < n; ) {
+        int len = n - done < WAVEGEN_BLOCK ? n - done : WAVEGEN_BLOCK;
+        uint64_t at = start + (uint64_t)done;
+        if (job->use_sin) {
+            // --sin: the original sin(2 * M_PI * FREQUENCY * t) generators
+            for (int j = 0; j < len; j++) out[done + j] = wavegen_select((double)(at + j) / job->rate, job->wave);
+        } else if (job->voices == 1) {
+            Oscillator o = job->osc[0];
+            o.phase += (uint32_t)(at * o.inc);
+            o.mod_phase += (uint32_t)(at * o.mod_inc);
+            job->render(&o, job->wave, out + done, len);
+        } else {
+            memset(mix, 0, sizeof(int32_t) * len);
+            for (int v = 0; v < job->voices; v++) {
+                Oscillator o = job->osc[v];
+                o.phase += (uint32_t)(at * o.inc);
+                o.mod_phase += (uint32_t)(at * o.mod_inc);
+                job->render(&o, job->wave, voice, len);
+                for (int j = 0; j < len; j++) mix[j] += voice[j];
+            }
+            for (int j = 0; j < len; j++) out[done + j] = (int16_t)(mix[j] / job->voices);
+        }
+        done += len;
+    }
+}
+
+// Thread pool for offline renders. Workers claim chunks in timeline order
+// and render them into a ring of slots; the main thread writes the slots out
+// strictly in order, so the output is identical to a serial render. A worker
+// waits while its chunk would overwrite one the writer has not reached yet.
+typedef struct {
+    const RenderJob *job;
+    uint64_t frames;                // 0 = until the reader goes away
+    int slots;
+    int16_t *buf;                   // slots * RENDER_CHUNK samples
+    int *len;                       // samples in each slot, -1 = not ready
+    uint64_t next_chunk;            // next chunk for a worker to claim
+    uint64_t written;               // chunks the writer has finished with
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} RenderPool;
+
+static int chunk_length(const RenderPool *pool, uint64_t chunk) {
+    uint64_t start = chunk * RENDER_CHUNK;
+    if (pool->frames == 0) return RENDER_CHUNK;
+    if (start >= pool->frames) return 0;
+    return pool->frames - start < RENDER_CHUNK ? (int)(pool->frames - start) : RENDER_CHUNK;
+}
+
+static void *render_worker(void *arg) {
+    RenderPool *pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->stop) {
+        uint64_t chunk = pool->next_chunk;
+        int n = chunk_length(pool, chunk);
+        if (n == 0) break;
+        if (chunk >= pool->written + (uint64_t)pool->slots) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+            continue;
+        }
+        pool->next_chunk++;
+        pthread_mutex_unlock(&pool->lock);
+
+        int slot = (int)(chunk % (uint64_t)pool->slots);
+        render_range(pool->job, chunk * RENDER_CHUNK, pool->buf + (size_t)slot * RENDER_CHUNK, n);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->len[slot] = n;
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Function to render a job on `threads` workers and write it out in order
+int render_parallel(const RenderJob *job, PcmOut *out, int threads) {
+    RenderPool pool = { .job = job, .frames = out->fmt.frames, .slots = threads * 2 };
+    pool.buf = malloc(sizeof(int16_t) * RENDER_CHUNK * (size_t)pool.slots);
+    pool.len = malloc(sizeof(int) * (size_t)pool.slots);
+    pthread_t *workers = malloc(sizeof(pthread_t) * (size_t)threads);
+    if (!pool.buf || !pool.len || !workers) return -1;
+    for (int s = 0; s < pool.slots; s++) pool.len[s] = -1;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+
+    int started = 0;
+    for (; started < threads; started++) {
+        if (pthread_create(&workers[started], NULL, render_worker, &pool) != 0) break;
+    }
+    if (started == 0) {
+        fprintf(stderr, "Failed to start render threads\n");
+        return -1;
+    }
+
+    for (uint64_t chunk = 0; chunk_length(&pool, chunk) > 0 && pcm_more(out); chunk++) {
+        int slot = (int)(chunk % (uint64_t)pool.slots);
+        pthread_mutex_lock(&pool.lock);
+        while (pool.len[slot] < 0) pthread_cond_wait(&pool.cond, &pool.lock);
+        int n = pool.len[slot];
+        pthread_mutex_unlock(&pool.lock);
+
+        const int16_t *s = pool.buf + (size_t)slot * RENDER_CHUNK;
+        for (int j = 0; j < n && pcm_more(out); j++) pcm_put_s16(out, s[j]);
+
+        pthread_mutex_lock(&pool.lock);
+        pool.len[slot] = -1;
+        pool.written++;
+        pthread_cond_broadcast(&pool.cond);
+        pthread_mutex_unlock(&pool.lock);
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = true;
+    pthread_cond_broadcast(&pool.cond);
+    pthread_mutex_unlock(&pool.lock);
+    for (int t = 0; t < started; t++) pthread_join(workers[t], NULL);
+
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.cond);
+    free(workers);
+    free(pool.len);
+    free(pool.buf);
+    return 0;
+}
+
+
 // Function to parse command-line argument and set wavegen_select
 WaveType get_opts(int argc, char *argv[]) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <wave_type>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <wave_type> [-f hz] [-i linear|cubic] [-k avx512|avx2|sse2|scalar]\n", argv[0]);
+        fprintf(stderr, "                   [-v voices] [-j threads, 0 = one per core] [--sin]\n");
+        fprintf(stderr, "       %s bench [samples]\n", argv[0]);
+        fprintf(stderr, "       %s check\n", argv[0]);
         fprintf(stderr, "Wave types: sine, square, fm, sample, triangle\n");
         exit(EXIT_FAILURE);
     }
@@ -138,20 +990,67 @@ WaveType get_opts(int argc, char *argv[]) {
 
 int main(int argc, char *argv[]) {
     // Pipe audio data to stdout (sox will read this)
-    WaveType gen_select = get_opts(argc, argv);
+    PcmFormat fmt = { .rate = SAMPLE_RATE, .channels = 1, .bits = 16, .frames = SAMPLE_RATE * DURATION };
+    pcm_parse_args(&argc, argv, &fmt);
+
+    // wavegen <wave> [-f hz] [-i linear|cubic] [-k kernel] [-v voices] [-j threads] [--sin]
+    double freq = 0;
+    Interp interp = INTERP_LINEAR;
+    const char *kernel_name = NULL;
+    bool use_sin = false;
+    int voices = 1, threads = 1;
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) freq = atof(argv[++i]);
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) interp = strcmp(argv[++i], "cubic") == 0 ? INTERP_CUBIC : INTERP_LINEAR;
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) kernel_name = argv[++i];
+        else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) voices = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--sin") == 0) use_sin = true;
+        else argv[kept++] = argv[i];
+    }
+    argc = kept;
 
+	osc_init_table();
 	initialize_wavetable(wavetable);
+    if (osc_init_mip_tables(wavetable) != 0) return EXIT_FAILURE;
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        run_osc_bench(argc > 2 ? atol(argv[2]) : 10000000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "check") == 0) {
+        long bad = check_kernels(true);
+        return bad ? EXIT_FAILURE : 0;
+    }
+    WaveType gen_select = get_opts(argc, argv);
+    RenderKernel render = pick_kernel(kernel_name)->render;
 
-    for (int i = 0; i < SAMPLE_RATE * DURATION; i++) {
-        double t = (double)i / SAMPLE_RATE;  // Time in seconds
+    // SAMPLE steps through one table entry per sample unless -f is given;
+    // FM keeps its carrier:modulator ratio at the chosen pitch
+    if (freq <= 0) freq = gen_select == SAMPLE ? (double)SAMPLE_RATE / WAVETABLE_SIZE : FREQUENCY;
+    RenderJob job;
+    render_job_init(&job, gen_select, freq, voices, interp, fmt.rate);
+    job.render = render;
+    job.use_sin = use_sin;
 
-        int16_t sample = wavegen_select(t, gen_select);
+    // -j 0: one render thread per core
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
 
-        // Write the sample as little-endian 16-bit PCM to stdout
-        fwrite(&sample, sizeof(int16_t), 1, stdout);
-	
+    PcmOut out;
+    if (pcm_open(&out, STDOUT_FILENO, &fmt) != 0) return EXIT_FAILURE;
+    if (threads > 1) {
+        if (render_parallel(&job, &out, threads) != 0) return EXIT_FAILURE;
+    } else {
+        static int16_t block[WAVEGEN_BLOCK];
+        while (pcm_more(&out)) {
+            int n = WAVEGEN_BLOCK;
+            if (fmt.frames && fmt.frames - out.frames < (uint64_t)n) n = (int)(fmt.frames - out.frames);
+            render_range(&job, out.frames, block, n);
+            for (int j = 0; j < n && pcm_more(&out); j++) pcm_put_s16(&out, block[j]);
+        }
     }
+    pcm_close(&out);
 
     return 0;
 }
-
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdint.h>
 
 #define MAX_TASKS 3
 
@@ -17,6 +18,20 @@ typedef struct {
     int id;
 } Task;
 
+typedef void (*TaskFunc)(Task *);
+
+#define TASK_CTX_SIZE 16   // bytes of per-task context, see hc_task_ctx()
+
+typedef struct {
+    Task task;              // first, so a task's Task* is also its entry
+    TaskFunc func;
+    _Alignas(8) uint8_t ctx[TASK_CTX_SIZE];  // zero until the task writes it
+} TaskEntry;
+
+// Typed access to the task's context block: locals that must survive a
+// yield live here instead of in function statics
+#define hc_task_ctx(task, type)   ((type *)((TaskEntry *)(task))->ctx)
+
 // Simulate delay by waiting N scheduler ticks
 #define hc_task_delay(task, ticks) \
   do {                             \
@@ -40,12 +55,16 @@ void task_blink(Task *task) {
 }
 
 // Task 2: Prints numbers every 2 ticks
+typedef struct {
+    int count;
+} CounterCtx;
+
 void task_counter(Task *task) {
-    static int count = 0;
+    CounterCtx *c = hc_task_ctx(task, CounterCtx);
     switch (task->state) {
         case 0:
         while (1) {
-            printf("[Task %d] Count: %d\n", task->id, count++);
+            printf("[Task %d] Count: %d\n", task->id, c->count++);
             hc_task_delay(task, 2);
         }
     }
@@ -67,13 +86,6 @@ void task_once(Task *task) {
 
 // === Tiny Scheduler ===
 
-typedef void (*TaskFunc)(Task *);
-
-typedef struct {
-    Task task;
-    TaskFunc func;
-} TaskEntry;
-
 TaskEntry tasks[MAX_TASKS];
 
 // Called once per scheduler tick
@@ -43,10 +43,11 @@ uint32_t millis() {
     case __LINE__:;                         \
   } while (!(cond))
 
-#define hc_task_every(task, interval_ms)                \
-  static uint32_t _last_run = 0;                        \
-  if (millis() - _last_run < (interval_ms)) return;     \
-  _last_run = millis()
+// The timestamp lives in the task's entry, so tasks sharing a body each
+// keep their own period
+#define hc_task_every(task, interval_ms)                                  \
+  if (millis() - ((TaskEntry *)(task))->every_last < (interval_ms)) return; \
+  ((TaskEntry *)(task))->every_last = millis()
 
 // === TASK TYPES ===
 
@@ -64,8 +65,9 @@ typedef struct {
 typedef void (*TaskFunc)(Task *);
 
 typedef struct {
-    Task task;
+    Task task;              // first, so a task's Task* is also its entry
     TaskFunc func;
+    uint32_t every_last;    // last hc_task_every() firing
 } TaskEntry;
 
 TaskEntry task_list[MAX_TASKS];
@@ -109,6 +111,7 @@ int register_task(TaskFunc func, uint8_t id, TaskPriority prio, TaskGroup group,
                 .wake_time = 0, .active = 1, .suspended = 0
             };
             task_list[i].func = func;
+            task_list[i].every_last = 0;
             return i;
         }
     }
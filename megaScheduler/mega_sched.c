@@ -12,8 +12,14 @@
     ✅ Watchdog timer (auto-reset unresponsive tasks)
     ✅ Logging/debugging hooks
     ✅ State snapshot API
+    ✅ Binary checkpoint/restore (versioned, mmap'd snapshot file)
+    ✅ Fork-join (spawn/join children) and task dependency graphs
+    ✅ Per-task context blocks carved from a static, cache-aligned arena
+    ✅ Per-resume execution budgets (report, demote or throttle overruns)
+    ✅ Live telemetry page in POSIX shared memory (seqlock, see sched_top.c)
     ✅ CLI-style debug commands (basic)
-    ✅ Single-file and portable (no heap allocation or OS dependencies)
+    ✅ No heap allocation; the core is plain C, while checkpoints and
+       telemetry use POSIX files, mmap and shm_open (plus sched_telemetry.h)
 
   Suitable for:
     - Embedded systems
@@ -31,16 +37,37 @@
 #include <string.h>
 #include <time.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#define MAX_TASKS     8
+#include "sched_telemetry.h"
+
+#define MAX_TASKS     16
 #define MAX_EVENTS    8
 #define MAX_GROUPS    4
+#define MAX_TASK_FUNCS 16
+#define MAX_SUCCESSORS 4
+#define CACHE_LINE    64
+#define ARENA_LINES   64            // task context arena: 64 x 64 bytes
+#define NO_TASK       0xFF
 #define WATCHDOG_TIMEOUT_MS 3000
+#define DEFAULT_BUDGET_US   2000    // max CPU time per resume (0 = unlimited)
+#define BUDGET_STRIKES      3       // consecutive overruns before the policy acts
+#define BUDGET_RECOVER_RUNS 10      // clean resumes to win back one priority level
+#define BUDGET_THROTTLE_MS  250
 
 typedef uint8_t TaskGroup;
 typedef uint8_t TaskPriority;
 typedef uint8_t EventID;
 
+typedef enum {
+    BUDGET_REPORT = 0,      // log overruns only
+    BUDGET_DEMOTE,          // drop a priority level per BUDGET_STRIKES overruns
+    BUDGET_THROTTLE         // push the next wake-up out by BUDGET_THROTTLE_MS
+} BudgetPolicy;
+
 typedef struct {
     int state;
     uint8_t id;
@@ -53,19 +80,55 @@ typedef struct {
     void *user_data;
     uint8_t watchdog_enabled;
     uint32_t watchdog_reset_time;
+    uint8_t parent;                     // id of joining parent, or NO_TASK
+    uint8_t pending;                    // unfinished children/predecessors
+    uint8_t blocked;                    // not scheduled until pending hits 0
+    uint8_t successor_count;
+    uint8_t successors[MAX_SUCCESSORS]; // ids released when this task ends
+    void *ctx;                          // per-task context, see hc_task_ctx()
+    uint8_t ctx_line;                   // first arena line of ctx
+    uint8_t ctx_lines;                  // arena lines owned (0 = no ctx)
+    uint32_t budget_us;                 // per-resume CPU budget (0 = none)
+    uint32_t last_exec_us;
+    uint32_t max_exec_us;
+    uint16_t overruns;
+    uint8_t strikes;                    // consecutive overruns
+    uint8_t clean_runs;                 // consecutive resumes within budget
+    TaskPriority base_priority;         // priority before any demotion
+    uint32_t run_count;
+    uint64_t run_time_us;
 } Task;
 
 typedef void (*TaskFunc)(Task*);
 
 typedef struct {
-    Task task;
+    Task task;                          // first, so a Task* is also its entry
     TaskFunc func;
     TaskFunc original_func;
+    uint32_t every_last;                // last hc_task_every() firing
 } TaskEntry;
 
 TaskEntry task_list[MAX_TASKS];
 uint8_t event_flags[MAX_EVENTS];
 uint8_t group_suspended[MAX_GROUPS];
+BudgetPolicy budget_policy = BUDGET_REPORT;   // demote and throttle are opt-in (console: budget)
+
+// Counters published through the telemetry page
+uint64_t stat_ticks;
+uint32_t stat_tick_max_us;
+uint32_t stat_events_set;
+uint32_t stat_watchdog_resets;
+uint32_t stat_budget_overruns;
+
+// Function pointers don't survive a restart, so checkpoints refer to
+// task functions by a stable id registered here.
+typedef struct {
+    uint16_t id;
+    TaskFunc func;
+} TaskFuncEntry;
+
+TaskFuncEntry func_registry[MAX_TASK_FUNCS];
+uint8_t func_registry_count = 0;
 
 uint32_t millis() {
     struct timespec ts;
@@ -73,6 +136,12 @@ uint32_t millis() {
     return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
 }
 
+uint32_t micros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
 #define hc_task_yield(task)        \
     do {                           \
         (task)->state = __LINE__; \
@@ -93,24 +162,109 @@ uint32_t millis() {
         case __LINE__:;                        \
     } while (!(cond))
 
+// Blocks until every child spawned with hc_spawn() has finished. The
+// scheduler doesn't run a blocked task at all; the last child to finish
+// unblocks it directly.
+#define hc_task_join(task)                     \
+    do {                                       \
+        if ((task)->pending) {                 \
+            (task)->blocked = 1;               \
+            hc_task_yield(task);               \
+        }                                      \
+    } while (0)
+
+// Typed access to the task's context block. Locals that must survive a
+// yield live here instead of in function statics, so each instance of a
+// task function gets its own copy.
+#define hc_task_ctx(task, type)   ((type *)(task)->ctx)
+
+// The timestamp lives in the task's entry, so two tasks sharing a body
+// each keep their own period.
 #define hc_task_every(task, interval_ms)       \
-    static uint32_t _last = 0;                 \
-    if (millis() - _last < (interval_ms)) return; \
-    _last = millis()
+    if (millis() - ((TaskEntry *)(task))->every_last < (interval_ms)) return; \
+    ((TaskEntry *)(task))->every_last = millis()
 
-int register_task(TaskFunc func, uint8_t id, TaskPriority prio, TaskGroup group, void *data) {
+int register_task_func(uint16_t id, TaskFunc func) {
+    if (func_registry_count >= MAX_TASK_FUNCS) return -1;
+    func_registry[func_registry_count++] = (TaskFuncEntry){ .id = id, .func = func };
+    return 0;
+}
+
+TaskFunc task_func_lookup(uint16_t id) {
+    for (int i = 0; i < func_registry_count; i++) {
+        if (func_registry[i].id == id) return func_registry[i].func;
+    }
+    return NULL;
+}
+
+int task_func_id(TaskFunc func, uint16_t *id) {
+    for (int i = 0; i < func_registry_count; i++) {
+        if (func_registry[i].func == func) {
+            *id = func_registry[i].id;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// === CONTEXT ARENA ===
+//
+// Context blocks are whole cache lines carved from one static arena. A
+// 64-bit map tracks used lines, so allocation is a first-fit scan for a run
+// of free bits and freeing clears them; nothing ever touches the heap.
+
+_Alignas(CACHE_LINE) uint8_t task_arena[ARENA_LINES * CACHE_LINE];
+uint64_t arena_map;
+
+static uint64_t arena_mask(int line, int lines) {
+    return (lines >= 64 ? ~0ULL : ((1ULL << lines) - 1)) << line;
+}
+
+static int arena_alloc(int lines) {
+    for (int line = 0; line + lines <= ARENA_LINES; line++) {
+        uint64_t mask = arena_mask(line, lines);
+        if (!(arena_map & mask)) {
+            arena_map |= mask;
+            memset(&task_arena[line * CACHE_LINE], 0, lines * CACHE_LINE);
+            return line;
+        }
+    }
+    return -1;
+}
+
+static void arena_free(Task *t) {
+    if (!t->ctx_lines) return;
+    arena_map &= ~arena_mask(t->ctx_line, t->ctx_lines);
+    t->ctx = NULL;
+    t->ctx_lines = 0;
+}
+
+int register_task_ctx(TaskFunc func, uint8_t id, TaskPriority prio, TaskGroup group,
+                      void *data, size_t ctx_size) {
+    int lines = (int)((ctx_size + CACHE_LINE - 1) / CACHE_LINE);
+    int line = 0;
+    if (lines > ARENA_LINES) return -1;
     for (int i = 0; i < MAX_TASKS; i++) {
         if (!task_list[i].task.active) {
+            if (lines && (line = arena_alloc(lines)) < 0) {
+                printf("[Log] Task %d: no room for %zu byte context\n", id, ctx_size);
+                return -1;
+            }
             task_list[i].task = (Task){
                 .id = id, .state = 0, .active = 1,
                 .priority = prio, .group = group,
                 .wake_time = 0, .last_run_time = millis(),
                 .user_data = data, .suspended = 0,
                 .watchdog_enabled = 1,
-                .watchdog_reset_time = millis() + WATCHDOG_TIMEOUT_MS
+                .watchdog_reset_time = millis() + WATCHDOG_TIMEOUT_MS,
+                .parent = NO_TASK,
+                .ctx = lines ? &task_arena[line * CACHE_LINE] : NULL,
+                .ctx_line = (uint8_t)line, .ctx_lines = (uint8_t)lines,
+                .budget_us = DEFAULT_BUDGET_US, .base_priority = prio
             };
             task_list[i].func = func;
             task_list[i].original_func = func;
+            task_list[i].every_last = 0;
             printf("[Log] Task %d registered (prio=%d, group=%d)\n", id, prio, group);
             return i;
         }
@@ -118,8 +272,17 @@ int register_task(TaskFunc func, uint8_t id, TaskPriority prio, TaskGroup group,
     return -1;
 }
 
+int register_task(TaskFunc func, uint8_t id, TaskPriority prio, TaskGroup group, void *data) {
+    return register_task_ctx(func, id, prio, group, data, 0);
+}
+
+#define register_task_typed(func, id, prio, group, data, type) \
+    register_task_ctx(func, id, prio, group, data, sizeof(type))
+
 void restart_task(int slot) {
     if (slot >= 0 && slot < MAX_TASKS && task_list[slot].task.active) {
+        Task *t = &task_list[slot].task;
+        if (t->ctx) memset(t->ctx, 0, t->ctx_lines * CACHE_LINE);
         task_list[slot].task.state = 0;
         task_list[slot].task.wake_time = 0;
         task_list[slot].task.last_run_time = millis();
@@ -129,10 +292,130 @@ void restart_task(int slot) {
     }
 }
 
+void task_set_budget(int slot, uint32_t budget_us) {
+    if (slot >= 0 && slot < MAX_TASKS) task_list[slot].task.budget_us = budget_us;
+}
+
+int find_task(uint8_t id) {
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (task_list[i].task.active && task_list[i].task.id == id) return i;
+    }
+    return -1;
+}
+
+// === FORK-JOIN / DEPENDENCIES ===
+
+static void dependency_done(uint8_t id) {
+    int slot = find_task(id);
+    if (slot < 0) return;
+    Task *w = &task_list[slot].task;
+    if (w->pending && --w->pending == 0) {
+        // The watchdog skipped it while blocked; restart its timeout so a
+        // long join or dependency wait doesn't count against it
+        w->blocked = 0;
+        w->watchdog_reset_time = millis() + WATCHDOG_TIMEOUT_MS;
+    }
+}
+
+// Called once when a task finishes or is removed: wakes the joining
+// parent and any successors whose last dependency this was.
+static void task_release(Task *t) {
+    if (t->parent != NO_TASK) dependency_done(t->parent);
+    for (int i = 0; i < t->successor_count; i++) dependency_done(t->successors[i]);
+    t->parent = NO_TASK;
+    t->successor_count = 0;
+}
+
+// Registers a child of the running task; join on it with hc_task_join().
+// Ids must be unique: completion is signalled by id, so a second task with
+// the same id would release the wrong waiters.
+int hc_spawn(Task *parent, TaskFunc func, uint8_t id, void *data) {
+    if (find_task(id) >= 0) {
+        printf("[Log] Task %d already exists, spawn refused\n", id);
+        return -1;
+    }
+    int slot = register_task(func, id, parent->priority, parent->group, data);
+    if (slot < 0) return -1;
+    task_list[slot].task.parent = parent->id;
+    parent->pending++;
+    return slot;
+}
+
+typedef struct {
+    TaskFunc func;
+    uint8_t id;
+    TaskPriority priority;
+    TaskGroup group;
+    void *user_data;
+} TaskGraphNode;
+
+typedef struct {
+    uint8_t from;   // must finish...
+    uint8_t to;     // ...before this one starts
+} TaskGraphEdge;
+
+// Submits a whole DAG at once. Nodes with predecessors start blocked and
+// are released by their last predecessor, so nothing polls. The graph is
+// checked (unique ids not already in use, fan-out, cycles, free slots)
+// before anything is registered.
+int hc_submit_graph(const TaskGraphNode *nodes, int n_nodes,
+                    const TaskGraphEdge *edges, int n_edges) {
+    uint8_t indegree[MAX_TASKS] = {0}, outdegree[MAX_TASKS] = {0};
+    int from_idx[MAX_TASKS * MAX_SUCCESSORS], to_idx[MAX_TASKS * MAX_SUCCESSORS];
+    int free_slots = 0;
+
+    if (n_nodes > MAX_TASKS || n_edges > MAX_TASKS * MAX_SUCCESSORS) return -1;
+    for (int i = 0; i < MAX_TASKS; i++) free_slots += !task_list[i].task.active;
+    if (n_nodes > free_slots) return -1;
+
+    for (int n = 0; n < n_nodes; n++) {
+        if (find_task(nodes[n].id) >= 0) return -1;
+        for (int m = 0; m < n; m++) if (nodes[m].id == nodes[n].id) return -1;
+    }
+
+    for (int e = 0; e < n_edges; e++) {
+        from_idx[e] = to_idx[e] = -1;
+        for (int n = 0; n < n_nodes; n++) {
+            if (nodes[n].id == edges[e].from) from_idx[e] = n;
+            if (nodes[n].id == edges[e].to) to_idx[e] = n;
+        }
+        if (from_idx[e] < 0 || to_idx[e] < 0) return -1;
+        if (++outdegree[from_idx[e]] > MAX_SUCCESSORS) return -1;
+        indegree[to_idx[e]]++;
+    }
+
+    // Kahn's algorithm: if not every node drains, there is a cycle
+    uint8_t remaining[MAX_TASKS], queue[MAX_TASKS];
+    int head = 0, tail = 0;
+    memcpy(remaining, indegree, sizeof(remaining));
+    for (int n = 0; n < n_nodes; n++) if (!remaining[n]) queue[tail++] = n;
+    while (head < tail) {
+        int n = queue[head++];
+        for (int e = 0; e < n_edges; e++) {
+            if (from_idx[e] == n && --remaining[to_idx[e]] == 0) queue[tail++] = to_idx[e];
+        }
+    }
+    if (tail != n_nodes) return -1;
+
+    for (int n = 0; n < n_nodes; n++) {
+        int slot = register_task(nodes[n].func, nodes[n].id, nodes[n].priority,
+                                 nodes[n].group, nodes[n].user_data);
+        Task *t = &task_list[slot].task;
+        t->pending = indegree[n];
+        t->blocked = indegree[n] > 0;
+        for (int e = 0; e < n_edges; e++) {
+            if (from_idx[e] == n) t->successors[t->successor_count++] = edges[e].to;
+        }
+    }
+    return 0;
+}
+
 void remove_task(int slot) {
     if (slot >= 0 && slot < MAX_TASKS) {
         printf("[Log] Task %d removed\n", task_list[slot].task.id);
         task_list[slot].task.active = 0;
+        task_release(&task_list[slot].task);
+        arena_free(&task_list[slot].task);
     }
 }
 
@@ -145,7 +428,10 @@ void group_resume(TaskGroup group) {
 }
 
 void event_set(EventID id) {
-    if (id < MAX_EVENTS) event_flags[id] = 1;
+    if (id < MAX_EVENTS) {
+        event_flags[id] = 1;
+        stat_events_set++;
+    }
 }
 
 void event_clear(EventID id) {
@@ -159,15 +445,149 @@ uint8_t event_check(EventID id) {
 void watchdog_check() {
     for (int i = 0; i < MAX_TASKS; i++) {
         Task *t = &task_list[i].task;
-        if (!t->active || !t->watchdog_enabled) continue;
+        if (!t->active || !t->watchdog_enabled || t->blocked) continue;
         if (millis() > t->watchdog_reset_time) {
             printf("[WDT] Task %d timeout. Restarting...\n", t->id);
+            stat_watchdog_resets++;
             restart_task(i);
         }
     }
 }
 
+// === EXECUTION BUDGET ===
+
+// Charges one resume to the task. A single overrun is only reported; a run
+// of BUDGET_STRIKES applies budget_policy, and a demoted task climbs back a
+// level after BUDGET_RECOVER_RUNS clean resumes.
+static void budget_account(Task *t, uint32_t used_us) {
+    t->last_exec_us = used_us;
+    t->run_count++;
+    t->run_time_us += used_us;
+    if (used_us > t->max_exec_us) t->max_exec_us = used_us;
+
+    if (!t->budget_us || used_us <= t->budget_us) {
+        t->strikes = 0;
+        if (t->priority < t->base_priority && ++t->clean_runs >= BUDGET_RECOVER_RUNS) {
+            t->clean_runs = 0;
+            t->priority++;
+            printf("[Budget] Task %d back to prio %d\n", t->id, t->priority);
+        }
+        return;
+    }
+
+    t->overruns++;
+    stat_budget_overruns++;
+    t->clean_runs = 0;
+    printf("[Budget] Task %d ran %u us (budget %u us)\n", t->id, used_us, t->budget_us);
+    if (++t->strikes < BUDGET_STRIKES) return;
+    t->strikes = 0;
+
+    switch (budget_policy) {
+        case BUDGET_DEMOTE:
+            if (t->priority > 0) {
+                t->priority--;
+                printf("[Budget] Task %d demoted to prio %d\n", t->id, t->priority);
+            }
+            break;
+        case BUDGET_THROTTLE:
+            if (t->wake_time < millis() + BUDGET_THROTTLE_MS) {
+                t->wake_time = millis() + BUDGET_THROTTLE_MS;
+            }
+            printf("[Budget] Task %d throttled for %d ms\n", t->id, BUDGET_THROTTLE_MS);
+            break;
+        case BUDGET_REPORT:
+        default:
+            break;
+    }
+}
+
+// === TELEMETRY ===
+
+_Static_assert(MAX_TASKS <= TELEMETRY_MAX_TASKS, "telemetry page too small for MAX_TASKS");
+
+TelemetryPage *telemetry;
+uint32_t telemetry_start_ms;
+
+void telemetry_open() {
+    int fd = shm_open(TELEMETRY_SHM_NAME, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        perror("[Telemetry] shm_open");
+        return;
+    }
+    if (ftruncate(fd, sizeof(TelemetryPage)) != 0) {
+        perror("[Telemetry] ftruncate");
+        close(fd);
+        return;
+    }
+    TelemetryPage *p = mmap(NULL, sizeof(TelemetryPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror("[Telemetry] mmap");
+        return;
+    }
+    // Readers reject the page until the magic is back in place
+    memset(p, 0, sizeof(*p));
+    p->version = TELEMETRY_VERSION;
+    p->size = sizeof(TelemetryPage);
+    p->pid = getpid();
+    p->max_tasks = MAX_TASKS;
+    atomic_thread_fence(memory_order_release);
+    p->magic = TELEMETRY_MAGIC;
+    telemetry = p;
+    telemetry_start_ms = millis();
+    printf("[Telemetry] Publishing to shm %s\n", TELEMETRY_SHM_NAME);
+}
+
+void telemetry_close() {
+    if (!telemetry) return;
+    munmap(telemetry, sizeof(TelemetryPage));
+    shm_unlink(TELEMETRY_SHM_NAME);
+    telemetry = NULL;
+}
+
+static void telemetry_publish(uint32_t tick_us) {
+    TelemetryPage *p = telemetry;
+    if (!p) return;
+    uint32_t now = millis();
+
+    telemetry_write_begin(p);
+    p->uptime_ms = now - telemetry_start_ms;
+    p->ticks = stat_ticks;
+    p->tick_us = tick_us;
+    p->tick_max_us = stat_tick_max_us;
+    p->runnable = p->delayed = p->blocked = p->suspended = 0;
+    for (int i = 0; i < MAX_TASKS; i++) {
+        const Task *t = &task_list[i].task;
+        TelemetryTask *tt = &p->tasks[i];
+        uint8_t susp = t->suspended || group_suspended[t->group];
+        if (t->active) {
+            if (t->blocked) p->blocked++;
+            else if (susp) p->suspended++;
+            else if (t->wake_time > now) p->delayed++;
+            else p->runnable++;
+        }
+        tt->id = t->id;
+        tt->active = t->active;
+        tt->suspended = susp;
+        tt->blocked = t->blocked;
+        tt->priority = t->priority;
+        tt->group = t->group;
+        tt->pending = t->pending;
+        tt->runs = t->run_count;
+        tt->last_exec_us = t->last_exec_us;
+        tt->max_exec_us = t->max_exec_us;
+        tt->overruns = t->overruns;
+        tt->total_exec_us = t->run_time_us;
+    }
+    p->events_set = stat_events_set;
+    p->watchdog_resets = stat_watchdog_resets;
+    p->budget_overruns = stat_budget_overruns;
+    telemetry_write_end(p);
+}
+
 void scheduler_tick() {
+    uint32_t tick_start = micros();
+
     for (int i = 0; i < MAX_TASKS - 1; i++) {
         for (int j = i + 1; j < MAX_TASKS; j++) {
             if (task_list[j].task.active && task_list[i].task.active &&
@@ -181,19 +601,28 @@ void scheduler_tick() {
 
     for (int i = 0; i < MAX_TASKS; i++) {
         Task *t = &task_list[i].task;
-        if (!t->active || t->suspended || group_suspended[t->group]) continue;
+        if (!t->active || t->blocked || t->suspended || group_suspended[t->group]) continue;
         if (millis() >= t->wake_time) {
             t->last_run_time = millis();
             t->watchdog_reset_time = millis() + WATCHDOG_TIMEOUT_MS;
+            uint32_t start = micros();
             task_list[i].func(t);
+            budget_account(t, micros() - start);
             if (t->state == -1) {
                 t->active = 0;
                 printf("[Log] Task %d completed\n", t->id);
+                task_release(t);
+                arena_free(t);
             }
         }
     }
 
     watchdog_check();
+
+    uint32_t tick_us = micros() - tick_start;
+    stat_ticks++;
+    if (tick_us > stat_tick_max_us) stat_tick_max_us = tick_us;
+    telemetry_publish(tick_us);
 }
 
 void dump_task_state() {
@@ -201,10 +630,284 @@ void dump_task_state() {
     for (int i = 0; i < MAX_TASKS; i++) {
         Task *t = &task_list[i].task;
         if (t->active) {
-            printf(" - Task %d | Prio %d | Group %d | Susp %d | WT: %u\n",
-                   t->id, t->priority, t->group, t->suspended, t->wake_time);
+            printf(" - Task %d | Prio %d | Group %d | Susp %d | Wait %d | WT: %u | Max %u us | Ovr %u\n",
+                   t->id, t->priority, t->group, t->suspended, t->pending, t->wake_time,
+                   t->max_exec_us, t->overruns);
+        }
+    }
+}
+
+// === CHECKPOINT / RESTORE ===
+//
+// The snapshot is a single fixed-size struct written through mmap, so a
+// restore is one open + mmap + copy. Resume points are __LINE__ values, so a
+// snapshot is only valid for the build that wrote it; the build stamp below
+// rejects anything else. Times are stored relative to the checkpoint since
+// the monotonic clock restarts with the machine.
+
+#define SNAPSHOT_MAGIC   0x50534348u  // "HCSP"
+#define SNAPSHOT_VERSION 4
+#define SNAPSHOT_BUILD   __DATE__ " " __TIME__
+
+typedef struct {
+    int32_t  state;
+    uint32_t wake_in;           // ms until wake_time at checkpoint
+    uint32_t watchdog_in;       // ms until watchdog_reset_time at checkpoint
+    uint16_t func_id;
+    uint16_t original_func_id;
+    uint8_t  id;
+    uint8_t  active;
+    uint8_t  suspended;
+    uint8_t  group;
+    uint8_t  priority;
+    uint8_t  watchdog_enabled;
+    uint8_t  parent;
+    uint8_t  pending;
+    uint8_t  blocked;
+    uint8_t  successor_count;
+    uint8_t  successors[MAX_SUCCESSORS];
+    uint8_t  ctx_line;
+    uint8_t  ctx_lines;
+    uint8_t  base_priority;
+    uint32_t budget_us;
+    uint16_t overruns;
+    uint8_t  pad[2];
+} SnapshotTask;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;              // sizeof(SchedulerSnapshot)
+    char     build[32];
+    uint8_t  max_tasks;
+    uint8_t  max_events;
+    uint8_t  max_groups;
+    uint8_t  pad;
+    SnapshotTask tasks[MAX_TASKS];
+    uint8_t  event_flags[MAX_EVENTS];
+    uint8_t  group_suspended[MAX_GROUPS];
+    uint64_t arena_map;
+    _Alignas(CACHE_LINE) uint8_t arena[ARENA_LINES * CACHE_LINE];
+} SchedulerSnapshot;
+
+static uint32_t ms_until(uint32_t when, uint32_t now) {
+    return when > now ? when - now : 0;
+}
+
+// Refuses (returns -1, nothing written) if any live task's function has
+// no registered id: skipping it would leave its arena lines marked in use
+// and its parent/successor links and pending counts pointing at nothing.
+int scheduler_checkpoint(const char *path) {
+    uint16_t fid;
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (!task_list[i].task.active) continue;
+        if (task_func_id(task_list[i].func, &fid) != 0 ||
+            task_func_id(task_list[i].original_func, &fid) != 0) {
+            printf("[Snapshot] Task %d has no registered function id, checkpoint refused\n",
+                   task_list[i].task.id);
+            return -1;
+        }
+    }
+
+    char tmp[256];
+    int len = snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if (len < 0 || len >= (int)sizeof(tmp)) {
+        printf("[Snapshot] Path too long: %s\n", path);
+        return -1;
+    }
+
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("[Snapshot] open");
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(SchedulerSnapshot)) != 0) {
+        perror("[Snapshot] ftruncate");
+        close(fd);
+        return -1;
+    }
+    SchedulerSnapshot *snap = mmap(NULL, sizeof(SchedulerSnapshot),
+                                   PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (snap == MAP_FAILED) {
+        perror("[Snapshot] mmap");
+        return -1;
+    }
+
+    uint32_t now = millis();
+    memset(snap, 0, sizeof(*snap));
+    snap->magic = SNAPSHOT_MAGIC;
+    snap->version = SNAPSHOT_VERSION;
+    snap->size = sizeof(SchedulerSnapshot);
+    strncpy(snap->build, SNAPSHOT_BUILD, sizeof(snap->build) - 1);
+    snap->max_tasks = MAX_TASKS;
+    snap->max_events = MAX_EVENTS;
+    snap->max_groups = MAX_GROUPS;
+
+    int saved = 0;
+    for (int i = 0; i < MAX_TASKS; i++) {
+        Task *t = &task_list[i].task;
+        SnapshotTask *st = &snap->tasks[i];
+        if (!t->active) continue;
+        task_func_id(task_list[i].func, &st->func_id);
+        task_func_id(task_list[i].original_func, &st->original_func_id);
+        st->state = t->state;
+        st->wake_in = ms_until(t->wake_time, now);
+        st->watchdog_in = ms_until(t->watchdog_reset_time, now);
+        st->id = t->id;
+        st->active = 1;
+        st->suspended = t->suspended;
+        st->group = t->group;
+        st->priority = t->priority;
+        st->watchdog_enabled = t->watchdog_enabled;
+        st->parent = t->parent;
+        st->pending = t->pending;
+        st->blocked = t->blocked;
+        st->successor_count = t->successor_count;
+        memcpy(st->successors, t->successors, sizeof(st->successors));
+        st->ctx_line = t->ctx_line;
+        st->ctx_lines = t->ctx_lines;
+        st->base_priority = t->base_priority;
+        st->budget_us = t->budget_us;
+        st->overruns = t->overruns;
+        saved++;
+    }
+    memcpy(snap->event_flags, event_flags, sizeof(event_flags));
+    memcpy(snap->group_suspended, group_suspended, sizeof(group_suspended));
+    snap->arena_map = arena_map;
+    memcpy(snap->arena, task_arena, sizeof(task_arena));
+
+    int rc = msync(snap, sizeof(SchedulerSnapshot), MS_SYNC);
+    munmap(snap, sizeof(SchedulerSnapshot));
+    if (rc != 0 || rename(tmp, path) != 0) {
+        perror("[Snapshot] commit");
+        unlink(tmp);
+        return -1;
+    }
+    printf("[Snapshot] Checkpointed %d tasks to %s\n", saved, path);
+    return saved;
+}
+
+// Restores over whatever has been registered so far. A task keeps its
+// user_data if a task with the same id is already registered, since
+// pointers cannot be carried across processes.
+int scheduler_restore(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size != (off_t)sizeof(SchedulerSnapshot)) {
+        printf("[Snapshot] %s: size mismatch, ignored\n", path);
+        close(fd);
+        return -1;
+    }
+    const SchedulerSnapshot *snap = mmap(NULL, sizeof(SchedulerSnapshot),
+                                         PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (snap == MAP_FAILED) {
+        perror("[Snapshot] mmap");
+        return -1;
+    }
+
+    int rc = -1;
+    if (snap->magic != SNAPSHOT_MAGIC || snap->version != SNAPSHOT_VERSION ||
+        snap->size != sizeof(SchedulerSnapshot)) {
+        printf("[Snapshot] %s: unsupported format, ignored\n", path);
+        goto out;
+    }
+    if (strncmp(snap->build, SNAPSHOT_BUILD, sizeof(snap->build)) != 0) {
+        printf("[Snapshot] %s: written by another build (%.32s), ignored\n", path, snap->build);
+        goto out;
+    }
+    if (snap->max_tasks != MAX_TASKS || snap->max_events != MAX_EVENTS ||
+        snap->max_groups != MAX_GROUPS) {
+        printf("[Snapshot] %s: table sizes differ, ignored\n", path);
+        goto out;
+    }
+
+    // Ids present, for checking the links below; each may appear once
+    uint8_t present[256] = { 0 };
+    for (int i = 0; i < MAX_TASKS; i++) {
+        const SnapshotTask *s = &snap->tasks[i];
+        if (!s->active) continue;
+        if (s->id == NO_TASK || present[s->id]) {
+            printf("[Snapshot] %s: task id %d invalid or repeated, ignored\n", path, s->id);
+            goto out;
+        }
+        present[s->id] = 1;
+    }
+
+    // Validate every record and resolve every function before touching
+    // live state: the fields index the arena, group and task tables
+    TaskFunc funcs[MAX_TASKS], originals[MAX_TASKS];
+    for (int i = 0; i < MAX_TASKS; i++) {
+        const SnapshotTask *s = &snap->tasks[i];
+        if (!s->active) continue;
+        int ok = s->group < MAX_GROUPS && s->successor_count <= MAX_SUCCESSORS &&
+                 s->ctx_line + s->ctx_lines <= ARENA_LINES &&
+                 (s->parent == NO_TASK || present[s->parent]);
+        for (int k = 0; ok && k < s->successor_count; k++) {
+            ok = s->successors[k] == NO_TASK || present[s->successors[k]];
+        }
+        if (ok && s->ctx_lines) {
+            uint64_t mask = arena_mask(s->ctx_line, s->ctx_lines);
+            ok = (snap->arena_map & mask) == mask;
+        }
+        if (!ok) {
+            printf("[Snapshot] Task %d: record out of range, ignored\n", s->id);
+            goto out;
+        }
+        funcs[i] = task_func_lookup(s->func_id);
+        originals[i] = task_func_lookup(s->original_func_id);
+        if (!funcs[i] || !originals[i]) {
+            printf("[Snapshot] Task %d: function id %u not registered, ignored\n",
+                   s->id, s->func_id);
+            goto out;
+        }
+    }
+
+    TaskEntry restored[MAX_TASKS];
+    memset(restored, 0, sizeof(restored));
+    uint32_t now = millis();
+    rc = 0;
+    for (int i = 0; i < MAX_TASKS; i++) {
+        const SnapshotTask *s = &snap->tasks[i];
+        if (!s->active) continue;
+        void *data = NULL;
+        for (int j = 0; j < MAX_TASKS; j++) {
+            if (task_list[j].task.active && task_list[j].task.id == s->id) {
+                data = task_list[j].task.user_data;
+                break;
+            }
         }
+        restored[i].task = (Task){
+            .id = s->id, .state = s->state, .active = 1,
+            .priority = s->priority, .group = s->group,
+            .wake_time = now + s->wake_in, .last_run_time = now,
+            .user_data = data, .suspended = s->suspended,
+            .watchdog_enabled = s->watchdog_enabled,
+            .watchdog_reset_time = now + s->watchdog_in,
+            .parent = s->parent, .pending = s->pending, .blocked = s->blocked,
+            .successor_count = s->successor_count,
+            .ctx = s->ctx_lines ? &task_arena[s->ctx_line * CACHE_LINE] : NULL,
+            .ctx_line = s->ctx_line, .ctx_lines = s->ctx_lines,
+            .budget_us = s->budget_us, .overruns = s->overruns,
+            .base_priority = s->base_priority
+        };
+        memcpy(restored[i].task.successors, s->successors, sizeof(s->successors));
+        restored[i].func = funcs[i];
+        restored[i].original_func = originals[i];
+        rc++;
     }
+    memcpy(task_list, restored, sizeof(task_list));
+    memcpy(event_flags, snap->event_flags, sizeof(event_flags));
+    memcpy(group_suspended, snap->group_suspended, sizeof(group_suspended));
+    arena_map = snap->arena_map;
+    memcpy(task_arena, snap->arena, sizeof(task_arena));
+
+out:
+    munmap((void *)snap, sizeof(SchedulerSnapshot));
+    return rc;
 }
 
 void debug_cli() {
@@ -219,30 +922,46 @@ void debug_cli() {
         } else if (strncmp(cmd, "resume ", 7) == 0) {
             int g = atoi(cmd + 7);
             group_resume((TaskGroup)g);
+        } else if (strncmp(cmd, "budget ", 7) == 0) {
+            if (strncmp(cmd + 7, "report", 6) == 0) budget_policy = BUDGET_REPORT;
+            else if (strncmp(cmd + 7, "demote", 6) == 0) budget_policy = BUDGET_DEMOTE;
+            else if (strncmp(cmd + 7, "throttle", 8) == 0) budget_policy = BUDGET_THROTTLE;
+        } else if (strncmp(cmd, "save ", 5) == 0) {
+            cmd[strcspn(cmd, "\r\n")] = '\0';
+            scheduler_checkpoint(cmd + 5);
         } else {
-            printf("Commands: dump | suspend <group> | resume <group>\n");
+            printf("Commands: dump | suspend <group> | resume <group> | save <file> |"
+                   " budget <report|demote|throttle>\n");
         }
     }
 }
 
+typedef struct {
+    int toggle;
+} BlinkCtx;
+
 void task_blink(Task *task) {
-    static int toggle = 0;
+    BlinkCtx *c = hc_task_ctx(task, BlinkCtx);
     switch (task->state) {
         case 0:
             while (1) {
-                printf("[Task %d] LED %s\n", task->id, toggle ? "ON" : "OFF");
-                toggle = !toggle;
+                printf("[Task %d] LED %s\n", task->id, c->toggle ? "ON" : "OFF");
+                c->toggle = !c->toggle;
                 hc_task_delay(task, 500);
             }
     }
 }
 
+typedef struct {
+    int count;
+} CounterCtx;
+
 void task_counter(Task *task) {
-    int *val = (int*)task->user_data;
+    CounterCtx *c = hc_task_ctx(task, CounterCtx);
     switch (task->state) {
         case 0:
-            while (*val < 10) {
-                printf("[Task %d] Counter: %d\n", task->id, (*val)++);
+            while (c->count < 10) {
+                printf("[Task %d] Counter: %d\n", task->id, c->count++);
                 hc_task_delay(task, 300);
             }
             task->state = -1;
@@ -260,15 +979,137 @@ void task_logger(Task *task) {
     }
 }
 
-int main() {
+// Usage: mega_sched [snapshot-file]
+// With a snapshot file, state is restored from it at startup (if present)
+// and checkpointed back to it at shutdown.
+void task_worker(Task *task) {
+    switch (task->state) {
+        case 0:
+            printf("[Worker %d] Started\n", task->id);
+            hc_task_delay(task, 200 * (task->id % 4 + 1));
+            printf("[Worker %d] Done\n", task->id);
+            task->state = -1;
+            return;
+    }
+}
+
+void task_fanout(Task *task) {
+    switch (task->state) {
+        case 0:
+            hc_task_delay(task, 1000);
+            printf("[Task %d] Fanning out 3 workers\n", task->id);
+            for (uint8_t i = 0; i < 3; i++) {
+                hc_spawn(task, task_worker, 10 + i, NULL);
+            }
+            hc_task_join(task);
+            printf("[Task %d] All workers joined\n", task->id);
+            task->state = -1;
+            return;
+    }
+}
+
+// Outlives the watchdog timeout in steps short enough to keep feeding it
+void task_slow_worker(Task *task) {
+    switch (task->state) {
+        case 0:
+            printf("[Worker %d] Started (slow)\n", task->id);
+            hc_task_delay(task, 1000);
+            hc_task_delay(task, 1000);
+            hc_task_delay(task, 1000);
+            hc_task_delay(task, 1000);
+            printf("[Worker %d] Done\n", task->id);
+            task->state = -1;
+            return;
+    }
+}
+
+// Joins on a child that takes longer than WATCHDOG_TIMEOUT_MS; the join
+// must not count against the parent's own watchdog
+void task_slow_join(Task *task) {
+    switch (task->state) {
+        case 0:
+            hc_spawn(task, task_slow_worker, 13, NULL);
+            hc_task_join(task);
+            printf("[Task %d] Slow worker joined\n", task->id);
+            task->state = -1;
+            return;
+    }
+}
+
+void task_stage(Task *task) {
+    switch (task->state) {
+        case 0:
+            printf("[Stage %d] Running\n", task->id);
+            hc_task_delay(task, 250);
+            task->state = -1;
+            return;
+    }
+}
+
+// Burns ~5 ms per resume, over its budget. Under the default report policy
+// each overrun is only logged; "budget demote" on the console demotes it.
+void task_hog(Task *task) {
+    CounterCtx *c = hc_task_ctx(task, CounterCtx);
+    switch (task->state) {
+        case 0:
+            while (c->count++ < 6) {
+                uint32_t until = micros() + 5000;
+                while ((int32_t)(micros() - until) < 0);
+                hc_task_delay(task, 400);
+            }
+            task->state = -1;
+            return;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *snapshot_path = argc > 1 ? argv[1] : NULL;
+
     memset(task_list, 0, sizeof(task_list));
     memset(event_flags, 0, sizeof(event_flags));
     memset(group_suspended, 0, sizeof(group_suspended));
+    arena_map = 0;
+    telemetry_open();
+
+    register_task_func(1, task_blink);
+    register_task_func(2, task_counter);
+    register_task_func(3, task_logger);
+    register_task_func(4, task_worker);
+    register_task_func(5, task_fanout);
+    register_task_func(6, task_stage);
+    register_task_func(7, task_hog);
+    register_task_func(8, task_slow_worker);
+    register_task_func(9, task_slow_join);
 
-    int count = 0;
-    register_task(task_blink, 0, 3, 0, NULL);
-    register_task(task_counter, 1, 2, 1, &count);
+    register_task_typed(task_blink, 0, 3, 0, NULL, BlinkCtx);
+    register_task_typed(task_counter, 1, 2, 1, NULL, CounterCtx);
     register_task(task_logger, 2, 1, 1, NULL);
+    register_task(task_fanout, 3, 2, 2, NULL);
+    register_task_typed(task_hog, 4, 3, 0, NULL, CounterCtx);
+    register_task(task_slow_join, 5, 2, 2, NULL);
+
+    // fetch(20) -> { decode(21), checksum(22) } -> publish(23)
+    const TaskGraphNode pipeline[] = {
+        { task_stage, 20, 2, 2, NULL }, { task_stage, 21, 2, 2, NULL },
+        { task_stage, 22, 2, 2, NULL }, { task_stage, 23, 2, 2, NULL },
+    };
+    const TaskGraphEdge pipeline_deps[] = {
+        { 20, 21 }, { 20, 22 }, { 21, 23 }, { 22, 23 },
+    };
+    if (hc_submit_graph(pipeline, 4, pipeline_deps, 4) != 0) {
+        printf("[Main] Pipeline graph rejected\n");
+    }
+
+    if (snapshot_path) {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        int restored = scheduler_restore(snapshot_path);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (restored >= 0) {
+            long us = (t1.tv_sec - t0.tv_sec) * 1000000L + (t1.tv_nsec - t0.tv_nsec) / 1000;
+            printf("[Snapshot] Restored %d tasks from %s in %ld us\n", restored, snapshot_path, us);
+        }
+    }
 
     uint32_t start = millis();
 
@@ -286,6 +1127,8 @@ int main() {
 
         if (millis() - start > 20000) {
             printf("\n[Main] Shutting down after 20 sec\n");
+            if (snapshot_path) scheduler_checkpoint(snapshot_path);
+            telemetry_close();
             break;
         }
     }
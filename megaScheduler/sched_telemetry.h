@@ -0,0 +1,98 @@
+/*
+ ============================================================================
+  sched_telemetry.h - Live telemetry page shared by mega_sched and sched_top
+ ============================================================================
+  mega_sched publishes its counters into a POSIX shared-memory object once
+  per scheduler tick. Updates are guarded by a seqlock: the writer bumps
+  `seq` to an odd value, writes, then bumps it to even again. It never
+  waits on readers, and readers simply retry if they raced a write, so a
+  sampling process cannot perturb the scheduler.
+
+  Bump TELEMETRY_VERSION whenever the layout below changes.
+
+  Author: seclorum
+  License: MIT
+============================================================================
+*/
+
+#ifndef SCHED_TELEMETRY_H
+#define SCHED_TELEMETRY_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#define TELEMETRY_SHM_NAME   "/mega_sched.telemetry"
+#define TELEMETRY_MAGIC      0x544c4348u  // "HCLT"
+#define TELEMETRY_VERSION    1
+#define TELEMETRY_MAX_TASKS  16
+
+typedef struct {
+    uint8_t  id;
+    uint8_t  active;
+    uint8_t  suspended;         // task or its group
+    uint8_t  blocked;
+    uint8_t  priority;
+    uint8_t  group;
+    uint8_t  pending;
+    uint8_t  pad;
+    uint32_t runs;
+    uint32_t last_exec_us;
+    uint32_t max_exec_us;
+    uint32_t overruns;
+    uint64_t total_exec_us;
+} TelemetryTask;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;              // sizeof(TelemetryPage)
+    int32_t  pid;
+    uint32_t max_tasks;
+    _Atomic uint32_t seq;       // odd while the scheduler is writing
+    uint32_t uptime_ms;
+    uint64_t ticks;
+    uint32_t tick_us;           // duration of the last scheduler_tick()
+    uint32_t tick_max_us;
+
+    // Queue depths at the end of the last tick
+    uint32_t runnable;
+    uint32_t delayed;
+    uint32_t blocked;
+    uint32_t suspended;
+
+    uint32_t events_set;
+    uint32_t watchdog_resets;
+    uint32_t budget_overruns;
+    uint32_t pad;
+
+    TelemetryTask tasks[TELEMETRY_MAX_TASKS];
+} TelemetryPage;
+
+// Writer side: bracket every update with these two calls.
+static inline void telemetry_write_begin(TelemetryPage *p) {
+    uint32_t s = atomic_load_explicit(&p->seq, memory_order_relaxed);
+    atomic_store_explicit(&p->seq, s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void telemetry_write_end(TelemetryPage *p) {
+    uint32_t s = atomic_load_explicit(&p->seq, memory_order_relaxed);
+    atomic_store_explicit(&p->seq, s + 1, memory_order_release);
+}
+
+// Reader side: copies a consistent snapshot of the page into `out`.
+// Gives up (returns -1) if the writer keeps it busy for too many attempts.
+static inline int telemetry_read(const TelemetryPage *p, TelemetryPage *out) {
+    for (int attempt = 0; attempt < 1000; attempt++) {
+        uint32_t s1 = atomic_load_explicit(&((TelemetryPage *)p)->seq, memory_order_acquire);
+        if (s1 & 1) continue;
+        memcpy(out, (const void *)p, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        uint32_t s2 = atomic_load_explicit(&((TelemetryPage *)p)->seq, memory_order_relaxed);
+        if (s1 == s2) return 0;
+    }
+    return -1;
+}
+
+#endif // SCHED_TELEMETRY_H
@@ -0,0 +1,99 @@
+/*
+ ============================================================================
+  sched_top.c - Sample mega_sched's live telemetry page from another process
+ ============================================================================
+  Maps the shared-memory page published by mega_sched read-only and prints
+  a summary every interval. Reads go through the seqlock in
+  sched_telemetry.h, so the scheduler never waits for us.
+
+  Usage: sched_top [interval_ms] [samples]
+         (defaults: 1000 ms, run until interrupted)
+
+  Author: seclorum
+  License: MIT
+============================================================================
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "sched_telemetry.h"
+
+static void print_sample(const TelemetryPage *now, const TelemetryPage *prev, uint32_t interval_ms) {
+    printf("\n[Telemetry] pid %d | up %u ms | ticks %llu | tick %u us (max %u us)\n",
+           now->pid, now->uptime_ms, (unsigned long long)now->ticks,
+           now->tick_us, now->tick_max_us);
+    printf("  queues: runnable %u | delayed %u | blocked %u | suspended %u\n",
+           now->runnable, now->delayed, now->blocked, now->suspended);
+    printf("  events set %u | watchdog resets %u | budget overruns %u\n",
+           now->events_set, now->watchdog_resets, now->budget_overruns);
+    printf("  %4s %4s %5s %5s %10s %8s %10s %10s %10s %6s\n",
+           "id", "prio", "group", "state", "runs", "runs/s", "last us", "max us", "total us", "ovr");
+
+    for (uint32_t i = 0; i < now->max_tasks && i < TELEMETRY_MAX_TASKS; i++) {
+        const TelemetryTask *t = &now->tasks[i];
+        if (!t->active) continue;
+
+        // Slots are re-sorted by priority, so match the previous sample by id
+        uint32_t prev_runs = 0;
+        for (uint32_t j = 0; prev && j < TELEMETRY_MAX_TASKS; j++) {
+            if (prev->tasks[j].active && prev->tasks[j].id == t->id) {
+                prev_runs = prev->tasks[j].runs;
+                break;
+            }
+        }
+        double rate = prev && interval_ms ? (t->runs - prev_runs) * 1000.0 / interval_ms : 0.0;
+        const char *state = t->blocked ? "block" : t->suspended ? "susp" : "ready";
+
+        printf("  %4u %4u %5u %5s %10u %8.1f %10u %10u %10llu %6u\n",
+               t->id, t->priority, t->group, state, t->runs, rate,
+               t->last_exec_us, t->max_exec_us,
+               (unsigned long long)t->total_exec_us, t->overruns);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t interval_ms = argc > 1 ? (uint32_t)atoi(argv[1]) : 1000;
+    long samples = argc > 2 ? atol(argv[2]) : -1;
+
+    int fd = shm_open(TELEMETRY_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+        perror("shm_open " TELEMETRY_SHM_NAME " (is mega_sched running?)");
+        return EXIT_FAILURE;
+    }
+    const TelemetryPage *page = mmap(NULL, sizeof(TelemetryPage), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+    if (page->magic != TELEMETRY_MAGIC || page->version != TELEMETRY_VERSION ||
+        page->size != sizeof(TelemetryPage)) {
+        fprintf(stderr, "Telemetry page has an unknown layout (version %u)\n", page->version);
+        return EXIT_FAILURE;
+    }
+
+    TelemetryPage cur, prev;
+    int have_prev = 0;
+    while (samples < 0 || samples-- > 0) {
+        if (telemetry_read(page, &cur) == 0) {
+            print_sample(&cur, have_prev ? &prev : NULL, interval_ms);
+            prev = cur;
+            have_prev = 1;
+        } else {
+            fprintf(stderr, "[Telemetry] writer busy, sample skipped\n");
+        }
+        struct timespec wait = { interval_ms / 1000, (interval_ms % 1000) * 1000000L };
+        nanosleep(&wait, NULL);
+    }
+
+    munmap((void *)page, sizeof(TelemetryPage));
+    return 0;
+}
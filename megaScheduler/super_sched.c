@@ -44,10 +44,15 @@ uint32_t millis() {
     case __LINE__:;                         \
   } while (!(cond))
 
-#define hc_task_every(task, interval_ms)                \
-  static uint32_t _last_run = 0;                        \
-  if (millis() - _last_run < (interval_ms)) return;     \
-  _last_run = millis()
+// The timestamp lives in the task's entry, so tasks sharing a body each
+// keep their own period
+#define hc_task_every(task, interval_ms)                                  \
+  if (millis() - ((TaskEntry *)(task))->every_last < (interval_ms)) return; \
+  ((TaskEntry *)(task))->every_last = millis()
+
+// Typed access to the task's context block: locals that must survive a
+// yield live here instead of in function statics
+#define hc_task_ctx(task, type)   ((type *)((TaskEntry *)(task))->ctx)
 
 // === TASK STRUCT ===
 
@@ -67,10 +72,14 @@ typedef struct {
 
 typedef void (*TaskFunc)(Task*);
 
+#define TASK_CTX_SIZE 16   // bytes of per-task context, see hc_task_ctx()
+
 typedef struct {
-    Task task;
+    Task task;              // first, so a task's Task* is also its entry
     TaskFunc func;
     TaskFunc initial_func;
+    uint32_t every_last;    // last hc_task_every() firing
+    _Alignas(8) uint8_t ctx[TASK_CTX_SIZE];  // zeroed at registration, kept across restarts
 } TaskEntry;
 
 TaskEntry task_list[MAX_TASKS];
@@ -133,6 +142,8 @@ int register_task(TaskFunc func, uint8_t id, TaskPriority prio, TaskGroup group,
             };
             task_list[i].func = func;
             task_list[i].initial_func = func;
+            task_list[i].every_last = 0;
+            memset(task_list[i].ctx, 0, TASK_CTX_SIZE);
             log_task_start(&task_list[i].task);
             return i;
         }
@@ -206,12 +217,16 @@ void scheduler_tick() {
 
 // === EXAMPLE TASKS ===
 
+typedef struct {
+    int count;
+} CounterCtx;
+
 void task_counter(Task *task) {
-    int *count = (int*)task->user_data;
+    CounterCtx *c = hc_task_ctx(task, CounterCtx);
     switch (task->state) {
         case 0:
-        while (*count < 5) {
-            printf("[Counter %d] %d\n", task->id, (*count)++);
+        while (c->count < 5) {
+            printf("[Counter %d] %d\n", task->id, c->count++);
             hc_task_delay(task, 400);
         }
         break;
@@ -219,13 +234,19 @@ void task_counter(Task *task) {
     task->state = -1;
 }
 
+typedef struct {
+    uint8_t retried;
+} FlakyCtx;
+
+// Stalls past the watchdog on its first run. The context outlives the
+// restart, so the second run knows it is a retry.
 void task_flaky(Task *task) {
-    static uint8_t fail = 1;
+    FlakyCtx *c = hc_task_ctx(task, FlakyCtx);
     switch (task->state) {
         case 0:
         printf("[Flaky %d] Running...\n", task->id);
-        if (fail) {
-            fail = 0;
+        if (!c->retried) {
+            c->retried = 1;
             hc_task_delay(task, 5000); // exceeds watchdog
         } else {
             printf("[Flaky %d] Success on retry.\n", task->id);
@@ -246,8 +267,7 @@ int main() {
     memset(event_flags, 0, sizeof(event_flags));
     memset(group_suspended, 0, sizeof(group_suspended));
 
-    int count = 0;
-    register_task(task_counter, 0, 2, 0, &count);
+    register_task(task_counter, 0, 2, 0, NULL);
     register_task(task_flaky, 1, 3, 0, NULL);
     register_task(task_logger, 2, 1, 1, NULL);
 
@@ -9,17 +9,36 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
 #include <time.h>
+#include <math.h>
 
 #ifdef _WIN32
 #include <windows.h>
 #else
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
 #endif
 
+#include "voice_tracker.h"
+
 #define MAX_VOICES 8
 #define NOTE_ON  1
 #define NOTE_OFF 0
+#define DEFAULT_VELOCITY 100
+
+#ifdef VOICE_TRACKER_LIB
+bool trace = false;                 // embedders opt in with vt_set_trace()
+#else
+bool trace = true;                  // print every voice change
+#endif
 
 // Timestamp in nanoseconds
 long long current_time_ns() {
@@ -40,22 +59,222 @@ long long current_time_ns() {
 #endif
 }
 
-// Notes being tracked are stored in a Deque
-typedef struct Node {
+// Monotonic timestamp in nanoseconds, for scheduling and event records
+long long monotonic_time_ns() {
+#ifdef _WIN32
+    return current_time_ns();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+#endif
+}
+
+// Binary event recording. Every tracker input (configuration and note
+// events) and every allocation decision it makes is appended as a fixed
+// 16-byte record with a monotonic timestamp. Replaying the inputs must
+// reproduce the decisions exactly, which makes a recording both a
+// regression test and a benchmark. A standalone Deque has no voice slots:
+// it records on channel 0 with slot -1, the note being the voice.
+#define RECORD_MAGIC "VTRC"
+#define RECORD_VERSION 1
+#define RECORD_BUFFER 4096          // records per write()
+
+typedef enum {
+    // Inputs
+    REC_RESET = 1,                  // arg = budget
+    REC_CHANNEL,                    // note = reserve, velocity = limit
+    REC_POLICY,                     // note = policy, velocity = REC_FLAG_* bits
+    REC_NOTE_ON,
+    REC_NOTE_OFF,
+    REC_VOICE_FINISHED,             // slot (standalone Deque: note)
+    REC_DEQUE,                      // standalone Deque run: note = policy, velocity = REC_FLAG_* bits
+    // Decisions
+    REC_ASSIGN = 16,                // slot now plays channel/note
+    REC_RETRIGGER,
+    REC_STEAL,
+    REC_FREE,
+    REC_RELEASE,
+    REC_DROP,
+} RecordKind;
+
+#define REC_FLAG_PROTECT_BASS 1
+#define REC_FLAG_HOLD_RELEASES 2
+
+typedef struct {
+    uint64_t time_ns;               // since the recording started
+    uint8_t kind;
+    uint8_t channel;
+    uint8_t note;
+    uint8_t velocity;
+    int16_t slot;
+    uint16_t arg;
+} EventRecord;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t pad;
+} RecordHeader;
+
+typedef struct {
+    FILE* out;                      // recording, or NULL when verifying
+    long long start_ns;
+    EventRecord buf[RECORD_BUFFER];
+    int buffered;
+    long records;
+
+    // Verify mode: decisions are checked against the recording instead
+    const EventRecord* expect;
+    long cursor;
+    long count;
+    long decisions;
+    long mismatches;
+} Recorder;
+
+Recorder* recorder;                 // NULL: recording off
+
+static void recorderFlush(Recorder* r) {
+    if (r->out && r->buffered) fwrite(r->buf, sizeof(EventRecord), r->buffered, r->out);
+    r->buffered = 0;
+}
+
+static const char* record_kind_name(int kind) {
+    static const char* inputs[] = { "?", "reset", "channel", "policy", "note-on", "note-off", "finished", "deque" };
+    static const char* decisions[] = { "assign", "retrigger", "steal", "free", "release", "drop" };
+    if (kind >= REC_RESET && kind <= REC_DEQUE) return inputs[kind];
+    if (kind >= REC_ASSIGN && kind <= REC_DROP) return decisions[kind - REC_ASSIGN];
+    return "?";
+}
+
+static void recordEvent(int kind, int ch, int note, int velocity, int slot, int arg) {
+    Recorder* r = recorder;
+    EventRecord rec = {
+        .kind = (uint8_t)kind, .channel = (uint8_t)ch, .note = (uint8_t)note,
+        .velocity = (uint8_t)velocity, .slot = (int16_t)slot, .arg = (uint16_t)arg,
+    };
+
+    if (r->expect) {
+        // Verifying: only decisions are produced here, in recorded order
+        const EventRecord* e = r->cursor < r->count ? &r->expect[r->cursor] : NULL;
+        r->decisions++;
+        if (e && e->kind == rec.kind && e->channel == rec.channel && e->note == rec.note &&
+            e->slot == rec.slot) {
+            r->cursor++;
+        } else if (r->mismatches++ < 10) {
+            printf("Mismatch at record %ld: replay %s ch %d note %d slot %d, recorded %s ch %d note %d slot %d\n",
+                   r->cursor, record_kind_name(rec.kind), rec.channel + 1, rec.note, rec.slot,
+                   e ? record_kind_name(e->kind) : "end", e ? e->channel + 1 : 0, e ? e->note : 0, e ? e->slot : 0);
+        }
+        return;
+    }
+
+    rec.time_ns = monotonic_time_ns() - r->start_ns;
+    r->buf[r->buffered++] = rec;
+    r->records++;
+    if (r->buffered == RECORD_BUFFER) recorderFlush(r);
+}
+
+#define RECORD(kind, ch, note, velocity, slot, arg) \
+    do { if (recorder && (recorder->out || (kind) >= REC_ASSIGN)) recordEvent(kind, ch, note, velocity, slot, arg); } while (0)
+
+int recorderOpen(Recorder* r, const char* path) {
+    memset(r, 0, sizeof(*r));
+    r->out = fopen(path, "wb");
+    if (!r->out) {
+        perror(path);
+        return -1;
+    }
+    RecordHeader h = { .version = RECORD_VERSION, .record_size = sizeof(EventRecord) };
+    memcpy(h.magic, RECORD_MAGIC, 4);
+    fwrite(&h, sizeof(h), 1, r->out);
+    r->start_ns = monotonic_time_ns();
+    return 0;
+}
+
+void recorderClose(Recorder* r) {
+    recorderFlush(r);
+    fclose(r->out);
+    r->out = NULL;
+}
+
+// Notes being tracked are stored in a Deque: an intrusive doubly linked
+// list threaded through a fixed node pool. Nodes come from a free list and
+// the NoteIndex maps each note straight to its node, so push, pop, steal
+// and remove are all O(1) and nothing touches the heap after createDeque().
+#define MIDI_NOTES 128
+#define DEQUE_CAPACITY MIDI_NOTES   // duplicates are refused, so never more than one node per note
+#define NIL -1
+
+typedef struct {
     int note;
-    struct Node* next;
+    int16_t prev;
+    int16_t next;
+    int16_t heap_pos;               // slot in the quietest-voice heap
+    int16_t slot;                   // VoiceTracker voice slot, NIL when standalone
+    uint8_t velocity;
 } Node;
 
+// How noteOn() picks a victim when every voice is busy. Each choice is O(1)
+// off the deque or the held/released bitmaps, or O(log n) via the heap.
+typedef enum {
+    STEAL_OLDEST = 0,               // rear of the deque (the original behaviour)
+    STEAL_QUIETEST,                 // lowest velocity, top of a min-heap
+    STEAL_LOWEST,                   // lowest pitch, ctz of the held set
+    STEAL_HIGHEST,                  // highest pitch, clz of the held set
+    STEAL_RELEASED,                 // a voice already in release, else the oldest
+    STEAL_POLICY_COUNT
+} StealPolicy;
+
+const char* steal_policy_names[STEAL_POLICY_COUNT] = {
+    "oldest", "quietest", "lowest", "highest", "released"
+};
+
+// Direct-mapped note -> voice (node) table plus a 128-bit occupancy map,
+// so duplicate checks, note-off lookup and "what is sounding" queries are
+// a table load or a popcount/ctz/clz away.
+typedef struct {
+    int16_t voice[MIDI_NOTES];      // node index, NIL when not held
+    uint64_t held[2];               // bit n set <=> note n held
+} NoteIndex;
+
 typedef struct {
-    Node* front;
-    Node* rear;
+    Node nodes[DEQUE_CAPACITY];
+    NoteIndex index;
+    int16_t front;
+    int16_t rear;
+    int16_t free_list;              // chained through Node.next
     int size;
+    int16_t heap[DEQUE_CAPACITY];   // node indices, min-heap on velocity
+    uint64_t released[2];           // held notes that are in their release phase
+    StealPolicy policy;
+    bool protect_bass;              // never steal the lowest held note
+    bool hold_releases;             // noteOff() releases; voiceFinished() frees
+    unsigned long steals;
 } Deque;
 
+void initDeque(Deque* dq) {
+    dq->front = dq->rear = NIL;
+    dq->size = 0;
+    for (int i = 0; i < DEQUE_CAPACITY; i++) {
+        dq->nodes[i].note = -1;
+        dq->nodes[i].prev = NIL;
+        dq->nodes[i].next = (i + 1 < DEQUE_CAPACITY) ? i + 1 : NIL;
+    }
+    dq->free_list = 0;
+    for (int n = 0; n < MIDI_NOTES; n++) dq->index.voice[n] = NIL;
+    dq->index.held[0] = dq->index.held[1] = 0;
+    dq->released[0] = dq->released[1] = 0;
+    dq->policy = STEAL_OLDEST;
+    dq->protect_bass = false;
+    dq->hold_releases = false;
+    dq->steals = 0;
+}
+
 Deque* createDeque() {
     Deque* dq = (Deque*)malloc(sizeof(Deque));
-    dq->front = dq->rear = NULL;
-    dq->size = 0;
+    initDeque(dq);
     return dq;
 }
 
@@ -63,112 +282,308 @@ bool isEmpty(Deque* dq) {
     return dq->size == 0;
 }
 
+static bool validNote(int note) {
+    return note >= 0 && note < MIDI_NOTES;
+}
+
 // Check if a note already exists in the deque
 bool noteExists(Deque* dq, int note) {
-    Node* temp = dq->front;
-    while (temp) {
-        if (temp->note == note) return true;
-        temp = temp->next;
+    return validNote(note) && ((dq->index.held[note >> 6] >> (note & 63)) & 1);
+}
+
+int heldNoteCount(Deque* dq) {
+    return __builtin_popcountll(dq->index.held[0]) + __builtin_popcountll(dq->index.held[1]);
+}
+
+// Lowest held note at or above `from`, or -1. Walk the sounding notes in
+// pitch order with: for (n = nextHeldNote(dq, 0); n >= 0; n = nextHeldNote(dq, n + 1))
+int nextHeldNote(Deque* dq, int from) {
+    if (from < 0) from = 0;
+    for (int w = from >> 6; w < 2; w++) {
+        uint64_t bits = dq->index.held[w];
+        if (w == from >> 6) bits &= ~0ULL << (from & 63);
+        if (bits) return (w << 6) + __builtin_ctzll(bits);
     }
-    return false;
+    return -1;
 }
 
-void pushFront(Deque* dq, int note) {
-    if (noteExists(dq, note)) return; // Prevent duplicate notes
-    Node* newNode = (Node*)malloc(sizeof(Node));
-    newNode->note = note;
-    newNode->next = dq->front;
-    dq->front = newNode;
-    if (dq->rear == NULL) dq->rear = newNode;
+int lowestHeldNote(Deque* dq) {
+    return nextHeldNote(dq, 0);
+}
+
+int highestHeldNote(Deque* dq) {
+    if (dq->index.held[1]) return 127 - __builtin_clzll(dq->index.held[1]);
+    if (dq->index.held[0]) return 63 - __builtin_clzll(dq->index.held[0]);
+    return -1;
+}
+
+static bool bitTest(const uint64_t set[2], int note) {
+    return (set[note >> 6] >> (note & 63)) & 1;
+}
+
+static void bitSet(uint64_t set[2], int note) {
+    set[note >> 6] |= 1ULL << (note & 63);
+}
+
+static void bitClear(uint64_t set[2], int note) {
+    set[note >> 6] &= ~(1ULL << (note & 63));
+}
+
+bool noteReleased(Deque* dq, int note) {
+    return validNote(note) && bitTest(dq->released, note);
+}
+
+// Quietest-voice heap. The heap size is always dq->size.
+static bool heapLess(Deque* dq, int a, int b) {
+    return dq->nodes[dq->heap[a]].velocity < dq->nodes[dq->heap[b]].velocity;
+}
+
+static void heapSwap(Deque* dq, int a, int b) {
+    int16_t t = dq->heap[a];
+    dq->heap[a] = dq->heap[b];
+    dq->heap[b] = t;
+    dq->nodes[dq->heap[a]].heap_pos = a;
+    dq->nodes[dq->heap[b]].heap_pos = b;
+}
+
+static void heapSiftUp(Deque* dq, int i) {
+    while (i > 0 && heapLess(dq, i, (i - 1) / 2)) {
+        heapSwap(dq, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void heapSiftDown(Deque* dq, int i, int size) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < size && heapLess(dq, l, m)) m = l;
+        if (r < size && heapLess(dq, r, m)) m = r;
+        if (m == i) return;
+        heapSwap(dq, i, m);
+        i = m;
+    }
+}
+
+static int16_t allocNode(Deque* dq, int note) {
+    int16_t n = dq->free_list;
+    if (n == NIL) return NIL;
+    dq->free_list = dq->nodes[n].next;
+    dq->nodes[n].note = note;
+    dq->index.voice[note] = n;
+    bitSet(dq->index.held, note);
+    dq->nodes[n].heap_pos = dq->size;
+    dq->heap[dq->size] = n;
     dq->size++;
+    heapSiftUp(dq, dq->nodes[n].heap_pos);
+    return n;
+}
+
+static void unlinkNode(Deque* dq, int16_t n) {
+    Node* node = &dq->nodes[n];
+    if (node->prev != NIL) dq->nodes[node->prev].next = node->next;
+    else dq->front = node->next;
+    if (node->next != NIL) dq->nodes[node->next].prev = node->prev;
+    else dq->rear = node->prev;
+
+    int last = dq->size - 1, pos = node->heap_pos;
+    if (pos != last) {
+        heapSwap(dq, pos, last);
+        heapSiftDown(dq, pos, last);
+        heapSiftUp(dq, pos);
+    }
+
+    dq->index.voice[node->note] = NIL;
+    bitClear(dq->index.held, node->note);
+    bitClear(dq->released, node->note);
+    node->note = -1;
+    node->prev = NIL;
+    node->next = dq->free_list;
+    dq->free_list = n;
+    dq->size--;
+}
+
+static void linkFront(Deque* dq, int16_t n) {
+    dq->nodes[n].prev = NIL;
+    dq->nodes[n].next = dq->front;
+    if (dq->front != NIL) dq->nodes[dq->front].prev = n;
+    dq->front = n;
+    if (dq->rear == NIL) dq->rear = n;
+}
+
+static int16_t insertNote(Deque* dq, int note, int velocity) {
+    if (!validNote(note) || noteExists(dq, note)) return NIL; // Prevent duplicate notes
+    int16_t n = dq->free_list;
+    if (n == NIL) return NIL;
+    dq->nodes[n].velocity = (uint8_t)velocity;
+    dq->nodes[n].slot = NIL;
+    return allocNode(dq, note);
+}
+
+void pushFront(Deque* dq, int note) {
+    int16_t n = insertNote(dq, note, DEFAULT_VELOCITY);
+    if (n != NIL) linkFront(dq, n);
 }
 
 void pushBack(Deque* dq, int note) {
-    if (noteExists(dq, note)) return; // Prevent duplicate notes
-    Node* newNode = (Node*)malloc(sizeof(Node));
-    newNode->note = note;
-    newNode->next = NULL;
-    if (dq->rear != NULL) dq->rear->next = newNode;
-    dq->rear = newNode;
-    if (dq->front == NULL) dq->front = newNode;
-    dq->size++;
+    int16_t n = insertNote(dq, note, DEFAULT_VELOCITY);
+    if (n == NIL) return;
+    dq->nodes[n].next = NIL;
+    dq->nodes[n].prev = dq->rear;
+    if (dq->rear != NIL) dq->nodes[dq->rear].next = n;
+    dq->rear = n;
+    if (dq->front == NIL) dq->front = n;
 }
 
 int popBack(Deque* dq) {
     if (isEmpty(dq)) return -1;
-    Node* temp = dq->front;
-    Node* prev = NULL;
-    while (temp->next) {
-        prev = temp;
-        temp = temp->next;
-    }
-    int note = temp->note;
-    free(temp);
-    if (prev) prev->next = NULL;
-    else dq->front = NULL;
-    dq->rear = prev;
-    dq->size--;
+    int note = dq->nodes[dq->rear].note;
+    unlinkNode(dq, dq->rear);
     return note;
 }
 
 void print_deque_contents(Deque* dq) {
-    Node* temp = dq->front;
+    int16_t n = dq->front;
     printf("Note state as of [%lld]: ", current_time_ns());
-    if (!temp) {
+    if (n == NIL) {
         printf("None");
     } else {
-        while (temp) {
-            printf("%d", temp->note);
-            if (temp->next) printf(", ");
-            temp = temp->next;
+        while (n != NIL) {
+            printf("%d", dq->nodes[n].note);
+            if (dq->nodes[n].next != NIL) printf(", ");
+            n = dq->nodes[n].next;
         }
     }
     printf("\n");
 }
 
+void print_held_notes(Deque* dq) {
+    printf("Held notes (%d, low %d, high %d):", heldNoteCount(dq), lowestHeldNote(dq), highestHeldNote(dq));
+    for (int n = nextHeldNote(dq, 0); n >= 0; n = nextHeldNote(dq, n + 1)) {
+        printf(" %d", n);
+    }
+    printf("\n");
+}
+
 // Set the state for a voice
 void synth_voice_ts(int voicenum, int state, Deque* dq) {
+    if (!trace) return;
     printf("Voice %d: [%lld ns]  %s \n", voicenum, current_time_ns(), state == 1 ? "NOTE ON" : "NOTE OFF" );
     print_deque_contents(dq);
 }
 
-void noteOn(Deque* dq, int note) {
-    if (dq->size >= MAX_VOICES) {
-        int stolenNote = popBack(dq);
-        if (stolenNote != -1) {
-            synth_voice_ts(stolenNote, NOTE_OFF, dq);
+// Chooses the note to steal under dq->policy, or -1 if nothing is held.
+int pickVictim(Deque* dq) {
+    if (isEmpty(dq)) return -1;
+    int bass = (dq->protect_bass && dq->size > 1) ? lowestHeldNote(dq) : -1;
+    int victim;
+
+    if (dq->policy == STEAL_RELEASED) {
+        uint64_t r[2] = { dq->released[0], dq->released[1] };
+        if (bass >= 0) bitClear(r, bass);
+        if (r[0]) return __builtin_ctzll(r[0]);
+        if (r[1]) return 64 + __builtin_ctzll(r[1]);
+    }
+
+    switch (dq->policy) {
+        case STEAL_QUIETEST: {
+            victim = dq->nodes[dq->heap[0]].note;
+            if (victim == bass) {
+                // Next quietest is one of the root's children
+                int c = (dq->size > 2 && heapLess(dq, 2, 1)) ? 2 : 1;
+                victim = dq->nodes[dq->heap[c]].note;
+            }
+            return victim;
         }
+        case STEAL_LOWEST:
+            victim = lowestHeldNote(dq);
+            return victim == bass ? nextHeldNote(dq, victim + 1) : victim;
+        case STEAL_HIGHEST:
+            return highestHeldNote(dq);
+        case STEAL_RELEASED:            // nothing in release
+        case STEAL_OLDEST:
+        default:
+            victim = dq->nodes[dq->rear].note;
+            return victim == bass ? dq->nodes[dq->nodes[dq->rear].prev].note : victim;
     }
-    pushFront(dq, note);
-    synth_voice_ts(note, NOTE_ON, dq);
 }
 
 void removeNote(Deque* dq, int note) {
-    Node* temp = dq->front;
-    Node* prev = NULL;
-    while (temp) {
-        if (temp->note == note) {
-            if (prev) prev->next = temp->next;
-            else dq->front = temp->next;
+    if (noteExists(dq, note)) unlinkNode(dq, dq->index.voice[note]);
+}
 
-            if (temp == dq->rear) {
-                dq->rear = prev;
-            }
+// A repeated note-on keeps its voice rather than stealing another one;
+// if the voice was releasing it is retriggered as the newest.
+static void retriggerNote(Deque* dq, int note) {
+    if (!noteReleased(dq, note)) return;
+    int16_t n = dq->index.voice[note];
+    bitClear(dq->released, note);
+    if (dq->front != n) {
+        if (dq->nodes[n].prev != NIL) dq->nodes[dq->nodes[n].prev].next = dq->nodes[n].next;
+        if (dq->nodes[n].next != NIL) dq->nodes[dq->nodes[n].next].prev = dq->nodes[n].prev;
+        else dq->rear = dq->nodes[n].prev;
+        linkFront(dq, n);
+    }
+}
 
-            free(temp);
-            dq->size--;
-            return;
+void noteOnVelocity(Deque* dq, int note, int velocity) {
+    // Out-of-range notes are dropped before they can steal a voice
+    if (!validNote(note)) return;
+    RECORD(REC_NOTE_ON, 0, note, velocity, -1, 0);
+    if (noteExists(dq, note)) {
+        retriggerNote(dq, note);
+        RECORD(REC_RETRIGGER, 0, note, velocity, -1, 0);
+    } else if (dq->size >= MAX_VOICES) {
+        int stolenNote = pickVictim(dq);
+        if (stolenNote != -1) {
+            RECORD(REC_STEAL, 0, stolenNote, 0, -1, 0);
+            removeNote(dq, stolenNote);
+            dq->steals++;
+            synth_voice_ts(stolenNote, NOTE_OFF, dq);
         }
-        prev = temp;
-        temp = temp->next;
     }
+    int16_t n = insertNote(dq, note, velocity);
+    if (n != NIL) {
+        linkFront(dq, n);
+        RECORD(REC_ASSIGN, 0, note, velocity, -1, 0);
+    }
+    synth_voice_ts(note, NOTE_ON, dq);
 }
 
-void noteOff(Deque* dq, int note) {
+void noteOn(Deque* dq, int note) {
+    noteOnVelocity(dq, note, DEFAULT_VELOCITY);
+}
+
+// The synth calls this when a released voice has finished sounding
+void voiceFinished(Deque* dq, int note) {
+    if (!validNote(note)) return;
+    RECORD(REC_VOICE_FINISHED, 0, note, 0, -1, 0);
+    if (!noteExists(dq, note)) return;
+    RECORD(REC_FREE, 0, note, 0, -1, 0);
     removeNote(dq, note);
+}
+
+void noteOff(Deque* dq, int note) {
+    if (!validNote(note)) return;
+    RECORD(REC_NOTE_OFF, 0, note, 0, -1, 0);
+    if (noteExists(dq, note)) {
+        if (dq->hold_releases) {
+            bitSet(dq->released, note);
+            RECORD(REC_RELEASE, 0, note, 0, -1, 0);
+        } else {
+            removeNote(dq, note);
+            RECORD(REC_FREE, 0, note, 0, -1, 0);
+        }
+    }
     synth_voice_ts(note, NOTE_OFF, dq);
 }
 
+// Marks the start of a standalone Deque run in the recording, so a replay
+// knows to drive a Deque with this configuration instead of a VoiceTracker.
+void recordDeque(Deque* dq) {
+    RECORD(REC_DEQUE, 0, dq->policy, (dq->protect_bass ? REC_FLAG_PROTECT_BASS : 0) |
+           (dq->hold_releases ? REC_FLAG_HOLD_RELEASES : 0), -1, 0);
+}
+
 void freeDeque(Deque* dq) {
     while (!isEmpty(dq)) popBack(dq);
     free(dq);
@@ -180,20 +595,1971 @@ void dumpDeque(Deque* dq) {
     }
 }
 
-void random_note_event(Deque* dq) {
-    int note = (rand() % 13) + 60;
-    int state = rand() % 2;
+// Monophonic (lead/legato) mode: one voice, any number of held keys. The
+// keys live in a Deque, whose node list doubles as the last-note stack
+// (newest at the front, any key unlinked in O(1) through the index) and
+// whose 128-bit held set answers low/high priority with a single ctz/clz.
+// When the sounding key is released the voice falls back to the best key
+// still held, with no list walk.
+typedef enum {
+    MONO_LAST = 0,                  // most recently pressed key wins
+    MONO_LOW,                       // lowest held key wins
+    MONO_HIGH,                      // highest held key wins
+    MONO_PRIORITY_COUNT
+} MonoPriority;
 
-    if (state == NOTE_ON) {
-        noteOn(dq, note);
+const char* mono_priority_names[MONO_PRIORITY_COUNT] = { "last", "low", "high" };
+
+typedef struct {
+    Deque keys;                     // every held key
+    MonoPriority priority;
+    bool legato;                    // pitch changes while sounding do not retrigger
+    int sounding;                   // note the voice is playing, -1 when silent
+    uint8_t velocity;
+} MonoVoice;
+
+void initMono(MonoVoice* m, MonoPriority priority, bool legato) {
+    initDeque(&m->keys);
+    m->priority = priority;
+    m->legato = legato;
+    m->sounding = -1;
+    m->velocity = 0;
+}
+
+static int monoTarget(MonoVoice* m) {
+    if (isEmpty(&m->keys)) return -1;
+    switch (m->priority) {
+        case MONO_LOW:
+            return lowestHeldNote(&m->keys);
+        case MONO_HIGH:
+            return highestHeldNote(&m->keys);
+        case MONO_LAST:
+        default:
+            return m->keys.nodes[m->keys.front].note;
+    }
+}
+
+static void synth_mono_ts(MonoVoice* m, const char* what) {
+    if (!trace) return;
+    printf("Mono [%s]: [%lld ns]  %s %d  (%d keys held)\n", mono_priority_names[m->priority],
+           current_time_ns(), what, m->sounding, m->keys.size);
+}
+
+// Moves the voice to whichever key now has priority
+static void monoUpdate(MonoVoice* m, bool pressed) {
+    int target = monoTarget(m);
+    if (target == m->sounding) return;
+    if (target < 0) {
+        synth_mono_ts(m, "NOTE OFF");
+        m->sounding = -1;
+        return;
+    }
+    bool was_sounding = m->sounding >= 0;
+    m->sounding = target;
+    m->velocity = m->keys.nodes[m->keys.index.voice[target]].velocity;
+    if (was_sounding && m->legato) synth_mono_ts(m, "LEGATO");
+    else synth_mono_ts(m, pressed || !was_sounding ? "NOTE ON" : "RETRIGGER");
+}
+
+// Returns the note the voice is playing afterwards, -1 if silent.
+int monoNoteOn(MonoVoice* m, int note, int velocity) {
+    if (!validNote(note)) return m->sounding;
+    removeNote(&m->keys, note);     // a repeated key moves to the top of the stack
+    int16_t n = insertNote(&m->keys, note, velocity);
+    linkFront(&m->keys, n);
+    monoUpdate(m, true);
+    return m->sounding;
+}
+
+int monoNoteOff(MonoVoice* m, int note) {
+    if (!validNote(note) || !noteExists(&m->keys, note)) return m->sounding;
+    removeNote(&m->keys, note);
+    monoUpdate(m, false);
+    return m->sounding;
+}
+
+// --mono: a lead line with overlapping keys, showing the fallback on release
+void run_mono_demo(MonoPriority priority, bool legato) {
+    MonoVoice m;
+    initMono(&m, priority, legato);
+    const int keys[][2] = {     // note, 1 = press / 0 = release
+        { 60, 1 }, { 64, 1 }, { 67, 1 }, { 64, 0 }, { 55, 1 }, { 67, 0 },
+        { 72, 1 }, { 55, 0 }, { 72, 0 }, { 60, 0 }, { 62, 1 }, { 62, 0 },
+    };
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if (trace) printf("key %d %s\n", keys[i][0], keys[i][1] ? "down" : "up");
+        if (keys[i][1]) monoNoteOn(&m, keys[i][0], DEFAULT_VELOCITY);
+        else monoNoteOff(&m, keys[i][0]);
+    }
+}
+
+// Multitimbral / MPE voice allocation: one Deque of held notes per MIDI
+// channel, all drawing voice slots from a shared global budget. Each channel
+// has a reserve (voices it is always guaranteed) and a limit (most it may
+// hold). Voice data is SoA and the busy slots are kept in a dense list, so a
+// render thread can stream over active voices without scanning free ones.
+#define MIDI_CHANNELS 16
+#define TRACKER_VOICES 32
+
+typedef struct {
+    Deque notes;                    // this channel's held notes, in age order
+    uint8_t reserve;
+    uint8_t limit;
+} ChannelPool;
+
+typedef struct {
+    ChannelPool channels[MIDI_CHANNELS];
+    int budget;                     // global voice budget, <= TRACKER_VOICES
+    int free_count;
+    int16_t free_stack[TRACKER_VOICES];
+    int reserve_outstanding;        // sum of unfilled channel reserves
+
+    int8_t voice_channel[TRACKER_VOICES];   // -1 when free
+    int8_t voice_note[TRACKER_VOICES];
+    uint8_t voice_velocity[TRACKER_VOICES];
+    uint32_t voice_age[TRACKER_VOICES];     // allocation serial, lower = older
+
+    int16_t active[TRACKER_VOICES];         // busy slots, densely packed
+    int16_t active_pos[TRACKER_VOICES];
+    int active_count;
+
+    uint32_t serial;
+    unsigned long steals;
+} VoiceTracker;
+
+// Allocation telemetry, for sizing polyphony from real data. Fixed-size
+// counters only, updated from the tracker's assign/free/steal paths when
+// tracker_stats is set; each update is a few adds. Time comes from
+// monotonic_time_ns(), or from trackerStatsSetTime() when the caller runs
+// on its own clock (MIDI file ticks, audio frames).
+#define STATS_MAGIC "VTST"
+#define STATS_VERSION 1
+#define LIFETIME_BUCKETS 20         // bucket b: lifetimes of [2^(b-1), 2^b) ms, bucket 0: under 1 ms
+
+typedef struct {
+    uint64_t start_ns;
+    uint64_t clock_ns;              // caller's time, when external_clock
+    bool external_clock;
+
+    uint64_t level_ns[TRACKER_VOICES + 1];      // time spent with n voices busy
+    uint64_t level_since_ns;
+    int level;                      // voices busy since level_since_ns
+    int peak_level;
+
+    uint64_t assigned;
+    uint64_t retriggers;            // note-on for a releasing note: reused its voice
+    uint64_t duplicates;            // note-on for a note already sounding: ignored
+    uint64_t dropped;               // note-on with no voice to be had
+    uint64_t released;              // note-offs for held notes
+    uint64_t ended;                 // voices freed, stolen ones included
+    uint64_t steals;
+    uint64_t steal_window;          // the second the count below belongs to
+    uint64_t window_steals;
+    uint64_t peak_steals_per_s;
+
+    uint64_t lifetime[LIFETIME_BUCKETS];
+    uint64_t lifetime_total_ns;
+    uint64_t slot_start_ns[TRACKER_VOICES];
+} TrackerStats;
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t size;                  // sizeof(TrackerStats)
+} StatsHeader;
+
+TrackerStats* tracker_stats = NULL;     // where trackers report, if anywhere
+
+void initTrackerStats(TrackerStats* s) {
+    memset(s, 0, sizeof(*s));
+    s->start_ns = monotonic_time_ns();
+}
+
+static uint64_t statsNow(TrackerStats* s) {
+    return s->external_clock ? s->clock_ns : (uint64_t)monotonic_time_ns() - s->start_ns;
+}
+
+void trackerStatsSetTime(uint64_t ns) {
+    if (!tracker_stats) return;
+    tracker_stats->external_clock = true;
+    tracker_stats->clock_ns = ns;
+}
+
+// Charges the time since the last change to the old voice count
+static void statsLevel(TrackerStats* s, int level) {
+    uint64_t now = statsNow(s);
+    if (now > s->level_since_ns) s->level_ns[s->level] += now - s->level_since_ns;
+    s->level_since_ns = now;        // a clock that restarted (a new pass) charges nothing
+    s->level = level;
+    if (level > s->peak_level) s->peak_level = level;
+}
+
+static void statsAssign(TrackerStats* s, int slot, int level) {
+    s->assigned++;
+    statsLevel(s, level);
+    s->slot_start_ns[slot] = s->level_since_ns;
+}
+
+static void statsFree(TrackerStats* s, int slot, int level) {
+    s->ended++;
+    statsLevel(s, level);
+    uint64_t life = s->level_since_ns > s->slot_start_ns[slot] ? s->level_since_ns - s->slot_start_ns[slot] : 0;
+    uint64_t ms = life / 1000000;
+    int b = ms ? 64 - __builtin_clzll(ms) : 0;
+    s->lifetime[b < LIFETIME_BUCKETS ? b : LIFETIME_BUCKETS - 1]++;
+    s->lifetime_total_ns += life;
+}
+
+static void statsSteal(TrackerStats* s) {
+    uint64_t second = s->level_since_ns / 1000000000ULL;
+    if (second != s->steal_window) {
+        s->steal_window = second;
+        s->window_steals = 0;
+    }
+    s->steals++;
+    if (++s->window_steals > s->peak_steals_per_s) s->peak_steals_per_s = s->window_steals;
+}
+
+void trackerStatsJson(TrackerStats* s, FILE* out) {
+    statsLevel(s, s->level);        // bring the current level's time up to date
+    double secs = s->level_since_ns / 1e9;
+
+    fprintf(out, "{\n  \"seconds\": %.3f,\n  \"peak_voices\": %d,\n", secs, s->peak_level);
+    fprintf(out, "  \"note_ons\": { \"assigned\": %llu, \"retriggered\": %llu, \"duplicates\": %llu, \"dropped\": %llu },\n",
+            (unsigned long long)s->assigned, (unsigned long long)s->retriggers,
+            (unsigned long long)s->duplicates, (unsigned long long)s->dropped);
+    fprintf(out, "  \"released\": %llu,\n  \"ended\": %llu,\n", (unsigned long long)s->released,
+            (unsigned long long)s->ended);
+    fprintf(out, "  \"steals\": %llu,\n  \"steals_per_s\": %.2f,\n  \"peak_steals_per_s\": %llu,\n",
+            (unsigned long long)s->steals, secs > 0 ? s->steals / secs : 0.0,
+            (unsigned long long)s->peak_steals_per_s);
+
+    fprintf(out, "  \"voices_busy_fraction\": [");
+    for (int n = 0; n <= TRACKER_VOICES; n++) {
+        fprintf(out, "%s%.5f", n ? ", " : "", s->level_since_ns ? (double)s->level_ns[n] / s->level_since_ns : 0.0);
+    }
+    fprintf(out, "],\n  \"lifetime_ms_below\": [");
+    for (int b = 0; b < LIFETIME_BUCKETS; b++) {
+        if (b == LIFETIME_BUCKETS - 1) fprintf(out, ", null");
+        else fprintf(out, "%s%llu", b ? ", " : "", 1ULL << b);
+    }
+    fprintf(out, "],\n  \"lifetime_count\": [");
+    for (int b = 0; b < LIFETIME_BUCKETS; b++) {
+        fprintf(out, "%s%llu", b ? ", " : "", (unsigned long long)s->lifetime[b]);
+    }
+    fprintf(out, "],\n  \"lifetime_mean_ms\": %.3f\n}\n", s->ended ? s->lifetime_total_ns / 1e6 / s->ended : 0.0);
+}
+
+// JSON if the path ends in .json or is "-" (stdout), otherwise a binary
+// snapshot that --stats-dump turns back into JSON.
+int trackerStatsWrite(TrackerStats* s, const char* path) {
+    size_t len = strlen(path);
+    bool json = strcmp(path, "-") == 0 || (len > 5 && strcmp(path + len - 5, ".json") == 0);
+    FILE* out = strcmp(path, "-") == 0 ? stdout : fopen(path, json ? "w" : "wb");
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    if (json) {
+        trackerStatsJson(s, out);
     } else {
-        noteOff(dq, note);
+        statsLevel(s, s->level);
+        StatsHeader h = { .version = STATS_VERSION, .size = sizeof(TrackerStats) };
+        memcpy(h.magic, STATS_MAGIC, 4);
+        fwrite(&h, sizeof(h), 1, out);
+        fwrite(s, sizeof(*s), 1, out);
     }
+    if (out != stdout) fclose(out);
+    return 0;
 }
 
-int main() {
-    Deque* dq = createDeque();
-    int cnt = 0;
+int trackerStatsRead(TrackerStats* s, const char* path) {
+    FILE* in = fopen(path, "rb");
+    StatsHeader h;
+    if (!in) {
+        perror(path);
+        return -1;
+    }
+    bool ok = fread(&h, sizeof(h), 1, in) == 1 && memcmp(h.magic, STATS_MAGIC, 4) == 0 &&
+              h.version == STATS_VERSION && h.size == sizeof(TrackerStats) && fread(s, sizeof(*s), 1, in) == 1;
+    fclose(in);
+    if (!ok) fprintf(stderr, "%s: not a version %d tracker stats snapshot\n", path, STATS_VERSION);
+    return ok ? 0 : -1;
+}
+
+void initTracker(VoiceTracker* vt, int budget) {
+    if (budget > TRACKER_VOICES) budget = TRACKER_VOICES;
+    vt->budget = budget;
+    for (int c = 0; c < MIDI_CHANNELS; c++) {
+        initDeque(&vt->channels[c].notes);
+        vt->channels[c].reserve = 0;
+        vt->channels[c].limit = (uint8_t)budget;
+    }
+    vt->free_count = 0;
+    for (int v = budget - 1; v >= 0; v--) vt->free_stack[vt->free_count++] = v;
+    for (int v = 0; v < TRACKER_VOICES; v++) {
+        vt->voice_channel[v] = -1;
+        vt->active_pos[v] = NIL;
+    }
+    vt->reserve_outstanding = 0;
+    vt->active_count = 0;
+    vt->serial = 0;
+    vt->steals = 0;
+    if (tracker_stats) statsLevel(tracker_stats, 0);
+    RECORD(REC_RESET, 0, 0, 0, -1, budget);
+}
+
+VoiceTracker* createTracker(int budget) {
+    VoiceTracker* vt = (VoiceTracker*)malloc(sizeof(VoiceTracker));
+    initTracker(vt, budget);
+    return vt;
+}
+
+static int channelUnfilledReserve(VoiceTracker* vt, int ch) {
+    int unfilled = vt->channels[ch].reserve - vt->channels[ch].notes.size;
+    return unfilled > 0 ? unfilled : 0;
+}
+
+// Free voices always cover the unfilled reserves, so a channel may take one
+// only if more are free than the other channels are still owed.
+static bool canTakeVoice(VoiceTracker* vt, int ch) {
+    return vt->free_count > vt->reserve_outstanding - channelUnfilledReserve(vt, ch);
+}
+
+// Fails (returns -1) if the reserves would exceed the global budget.
+int trackerSetChannel(VoiceTracker* vt, int ch, int reserve, int limit) {
+    if (ch < 0 || ch >= MIDI_CHANNELS || reserve < 0 || limit < reserve || limit > vt->budget) return -1;
+    int total = reserve;
+    for (int c = 0; c < MIDI_CHANNELS; c++) {
+        if (c != ch) total += vt->channels[c].reserve;
+    }
+    if (total > vt->budget) return -1;
+
+    vt->reserve_outstanding -= channelUnfilledReserve(vt, ch);
+    vt->channels[ch].reserve = (uint8_t)reserve;
+    vt->channels[ch].limit = (uint8_t)limit;
+    vt->reserve_outstanding += channelUnfilledReserve(vt, ch);
+    RECORD(REC_CHANNEL, ch, reserve, limit, -1, 0);
+    return 0;
+}
+
+void trackerSetPolicy(VoiceTracker* vt, int ch, StealPolicy policy, bool protect_bass, bool hold_releases) {
+    if (ch < 0 || ch >= MIDI_CHANNELS) return;
+    Deque* dq = &vt->channels[ch].notes;
+    dq->policy = policy;
+    dq->protect_bass = protect_bass;
+    dq->hold_releases = hold_releases;
+    RECORD(REC_POLICY, ch, policy, (protect_bass ? REC_FLAG_PROTECT_BASS : 0) |
+           (hold_releases ? REC_FLAG_HOLD_RELEASES : 0), -1, 0);
+}
+
+// MPE lower zone: channel 0 is the manager channel and carries no notes,
+// channels 1..members are member channels with one voice each.
+void trackerConfigureMpe(VoiceTracker* vt, int members) {
+    if (members > MIDI_CHANNELS - 1) members = MIDI_CHANNELS - 1;
+    trackerSetChannel(vt, 0, 0, 0);
+    for (int c = 1; c <= members; c++) trackerSetChannel(vt, c, 0, 1);
+}
+
+void synth_voice_ch_ts(VoiceTracker* vt, int slot, int ch, int note, int state) {
+    if (!trace) return;
+    printf("Voice %d [ch %d note %d]: [%lld ns]  %s  (%d/%d voices busy)\n", slot, ch + 1, note,
+           current_time_ns(), state == NOTE_ON ? "NOTE ON" : "NOTE OFF",
+           vt->active_count, vt->budget);
+}
+
+static void trackerFreeNote(VoiceTracker* vt, int ch, int note) {
+    Deque* dq = &vt->channels[ch].notes;
+    int16_t slot = dq->nodes[dq->index.voice[note]].slot;
+    removeNote(dq, note);
+    if (dq->size < vt->channels[ch].reserve) vt->reserve_outstanding++;
+
+    vt->voice_channel[slot] = -1;
+    int pos = vt->active_pos[slot];
+    int16_t last = vt->active[--vt->active_count];
+    vt->active[pos] = last;
+    vt->active_pos[last] = pos;
+    vt->active_pos[slot] = NIL;
+    vt->free_stack[vt->free_count++] = slot;
+    if (tracker_stats) statsFree(tracker_stats, slot, vt->active_count);
+}
+
+// Channel to steal from when the global budget is exhausted: the one
+// furthest over its reserve, oldest voice breaking ties. A fixed 16-way
+// scan, so still constant time.
+static int pickVictimChannel(VoiceTracker* vt) {
+    int best = -1, best_excess = 0;
+    uint32_t best_age = 0;
+    for (int c = 0; c < MIDI_CHANNELS; c++) {
+        Deque* dq = &vt->channels[c].notes;
+        int excess = dq->size - vt->channels[c].reserve;
+        if (excess <= 0) continue;
+        uint32_t age = vt->voice_age[dq->nodes[dq->rear].slot];
+        if (excess > best_excess || (excess == best_excess && age < best_age)) {
+            best = c;
+            best_excess = excess;
+            best_age = age;
+        }
+    }
+    return best;
+}
+
+static void trackerSteal(VoiceTracker* vt, int ch) {
+    int victim = pickVictim(&vt->channels[ch].notes);
+    if (victim < 0) return;
+    int16_t slot = vt->channels[ch].notes.nodes[vt->channels[ch].notes.index.voice[victim]].slot;
+    trackerFreeNote(vt, ch, victim);
+    vt->steals++;
+    if (tracker_stats) statsSteal(tracker_stats);
+    RECORD(REC_STEAL, ch, victim, 0, slot, 0);
+    synth_voice_ch_ts(vt, slot, ch, victim, NOTE_OFF);
+}
+
+static int16_t trackerRetrigger(VoiceTracker* vt, int ch, int note, int velocity) {
+    Deque* dq = &vt->channels[ch].notes;
+    if (tracker_stats) {
+        if (noteReleased(dq, note)) tracker_stats->retriggers++;
+        else tracker_stats->duplicates++;
+    }
+    retriggerNote(dq, note);
+    int16_t slot = dq->nodes[dq->index.voice[note]].slot;
+    RECORD(REC_RETRIGGER, ch, note, velocity, slot, 0);
+    synth_voice_ch_ts(vt, slot, ch, note, NOTE_ON);
+    return slot;
+}
+
+// Puts the note on a free voice; the caller has checked there is one.
+static int16_t trackerAssign(VoiceTracker* vt, int ch, int note, int velocity) {
+    ChannelPool* cp = &vt->channels[ch];
+    Deque* dq = &cp->notes;
+    int16_t slot = vt->free_stack[--vt->free_count];
+    int16_t n = insertNote(dq, note, velocity);
+    linkFront(dq, n);
+    dq->nodes[n].slot = slot;
+    if (dq->size <= cp->reserve) vt->reserve_outstanding--;
+
+    vt->voice_channel[slot] = (int8_t)ch;
+    vt->voice_note[slot] = (int8_t)note;
+    vt->voice_velocity[slot] = (uint8_t)velocity;
+    vt->voice_age[slot] = vt->serial++;
+    vt->active_pos[slot] = vt->active_count;
+    vt->active[vt->active_count++] = slot;
+    if (tracker_stats) statsAssign(tracker_stats, slot, vt->active_count);
+
+    RECORD(REC_ASSIGN, ch, note, velocity, slot, 0);
+    synth_voice_ch_ts(vt, slot, ch, note, NOTE_ON);
+    return slot;
+}
+
+// Returns the voice slot now playing the note, or -1 if it was dropped.
+int trackerNoteOn(VoiceTracker* vt, int ch, int note, int velocity) {
+    if (ch < 0 || ch >= MIDI_CHANNELS || !validNote(note)) return -1;
+    ChannelPool* cp = &vt->channels[ch];
+    Deque* dq = &cp->notes;
+    RECORD(REC_NOTE_ON, ch, note, velocity, -1, 0);
+
+    if (noteExists(dq, note)) return trackerRetrigger(vt, ch, note, velocity);
+
+    if (dq->size >= cp->limit) {
+        // At the channel limit: make room within the channel
+        trackerSteal(vt, ch);
+    } else if (!canTakeVoice(vt, ch)) {
+        // Every free voice is held back for other channels' reserves: take
+        // one from whichever channel is furthest over its reserve
+        int victim_ch = pickVictimChannel(vt);
+        trackerSteal(vt, victim_ch >= 0 ? victim_ch : ch);
+    }
+    if (dq->size >= cp->limit || !canTakeVoice(vt, ch)) {
+        if (trace) printf("Ch %d note %d dropped: no voice available\n", ch + 1, note);
+        RECORD(REC_DROP, ch, note, velocity, -1, 0);
+        if (tracker_stats) tracker_stats->dropped++;
+        return -1;
+    }
+    return trackerAssign(vt, ch, note, velocity);
+}
+
+void trackerVoiceFinished(VoiceTracker* vt, int slot) {
+    RECORD(REC_VOICE_FINISHED, 0, 0, 0, slot, 0);
+    if (slot < 0 || slot >= TRACKER_VOICES || vt->voice_channel[slot] < 0) return;
+    int ch = vt->voice_channel[slot], note = vt->voice_note[slot];
+    trackerFreeNote(vt, ch, note);
+    RECORD(REC_FREE, ch, note, 0, slot, 0);
+}
+
+// Releases a held note: marks it released, or frees its voice outright
+static void trackerRelease(VoiceTracker* vt, int ch, int note) {
+    Deque* dq = &vt->channels[ch].notes;
+    int16_t slot = dq->nodes[dq->index.voice[note]].slot;
+    if (tracker_stats) tracker_stats->released++;
+    if (dq->hold_releases) {
+        bitSet(dq->released, note);
+        RECORD(REC_RELEASE, ch, note, 0, slot, 0);
+    } else {
+        trackerFreeNote(vt, ch, note);
+        RECORD(REC_FREE, ch, note, 0, slot, 0);
+    }
+    synth_voice_ch_ts(vt, slot, ch, note, NOTE_OFF);
+}
+
+void trackerNoteOff(VoiceTracker* vt, int ch, int note) {
+    RECORD(REC_NOTE_OFF, ch, note, 0, -1, 0);
+    if (ch < 0 || ch >= MIDI_CHANNELS || !noteExists(&vt->channels[ch].notes, note)) return;
+    trackerRelease(vt, ch, note);
+}
+
+typedef struct {
+    uint64_t time_ns;               // capture time, monotonic_time_ns()
+    uint8_t type;                   // NOTE_ON / NOTE_OFF
+    uint8_t channel;
+    uint8_t note;
+    uint8_t velocity;
+} NoteEvent;
+
+// Events gathered per call by processBlock(), smfPlay() and --midi-in
+#define BATCH_CHUNK 64
+
+// Applies n events in order, exactly as calling trackerNoteOn() or
+// trackerNoteOff() for each one. It saves the caller a loop (and the FFI
+// one crossing per block), nothing more. Returns the number of note-ons
+// that ended up sounding (assigned or retriggered).
+int trackerApplyBatch(VoiceTracker* vt, const NoteEvent* ev, int n) {
+    int sounding = 0;
+    for (int i = 0; i < n; i++) {
+        if (ev[i].type == NOTE_ON) {
+            if (trackerNoteOn(vt, ev[i].channel, ev[i].note, ev[i].velocity) >= 0) sounding++;
+        } else {
+            trackerNoteOff(vt, ev[i].channel, ev[i].note);
+        }
+    }
+    return sounding;
+}
+
+void print_tracker_contents(VoiceTracker* vt) {
+    printf("Active voices (%d/%d):", vt->active_count, vt->budget);
+    for (int i = 0; i < vt->active_count; i++) {
+        int16_t v = vt->active[i];
+        printf(" %d=ch%d:%d", v, vt->voice_channel[v] + 1, vt->voice_note[v]);
+    }
+    printf("\n");
+}
+
+void random_note_event(Deque* dq) {
+    int note = (rand() % 13) + 60;
+    int state = rand() % 2;
+
+    if (state == NOTE_ON) {
+        noteOn(dq, note);
+    } else {
+        noteOff(dq, note);
+    }
+}
+
+// Dense random traffic through every stealing policy, with and without
+// bass protection. Events are generated up front so only the tracker is timed.
+void run_policy_benchmark(long events) {
+    typedef struct { uint8_t note, velocity, on; } BenchEvent;
+    BenchEvent* ev = (BenchEvent*)malloc(events * sizeof(BenchEvent));
+    srand(1);
+    for (long i = 0; i < events; i++) {
+        ev[i].note = 24 + rand() % 84;
+        ev[i].velocity = 1 + rand() % 127;
+        ev[i].on = (rand() % 10) < 6;
+    }
+
+    bool saved_trace = trace;
+    trace = false;
+    printf("Stealing policies, %ld events, %d voices\n", events, MAX_VOICES);
+    for (int p = 0; p < STEAL_POLICY_COUNT; p++) {
+        for (int bass = 0; bass < 2; bass++) {
+            Deque dq;
+            initDeque(&dq);
+            dq.policy = (StealPolicy)p;
+            dq.protect_bass = bass;
+            dq.hold_releases = (p == STEAL_RELEASED);
+
+            long long t0 = current_time_ns();
+            for (long i = 0; i < events; i++) {
+                if (ev[i].on) {
+                    noteOnVelocity(&dq, ev[i].note, ev[i].velocity);
+                } else if (dq.hold_releases && noteReleased(&dq, ev[i].note)) {
+                    voiceFinished(&dq, ev[i].note);
+                } else {
+                    noteOff(&dq, ev[i].note);
+                }
+            }
+            long long ns = current_time_ns() - t0;
+
+            printf("  %-9s %-12s %7.1f ns/event %8.2f Mevents/s  %lu steals\n",
+                   steal_policy_names[p], bass ? "protect-bass" : "",
+                   (double)ns / events, events * 1000.0 / ns, dq.steals);
+        }
+    }
+    trace = saved_trace;
+    free(ev);
+}
+
+// Multitimbral demo: drums keep 2 reserved voices, the bass line is one
+// voice, a pad may use the rest of a small 12-voice budget.
+void run_channel_demo() {
+    VoiceTracker* vt = createTracker(12);
+    trackerSetChannel(vt, 9, 2, 4);     // drums
+    trackerSetChannel(vt, 1, 1, 1);     // bass
+    trackerSetChannel(vt, 0, 0, 12);    // pad
+    const int channels[] = { 0, 0, 0, 1, 9 };
+
+    for (int i = 0; i < 40; i++) {
+        int ch = channels[rand() % 5];
+        int note = (ch == 9 ? 36 : ch == 1 ? 28 : 60) + rand() % 12;
+        if (rand() % 3) trackerNoteOn(vt, ch, note, 1 + rand() % 127);
+        else trackerNoteOff(vt, ch, note);
+    }
+    print_tracker_contents(vt);
+    free(vt);
+}
+
+void run_channel_benchmark(long events) {
+    typedef struct { uint8_t ch, note, velocity, on; } BenchEvent;
+    BenchEvent* ev = (BenchEvent*)malloc(events * sizeof(BenchEvent));
+    srand(2);
+    for (long i = 0; i < events; i++) {
+        ev[i].ch = rand() % MIDI_CHANNELS;
+        ev[i].note = 24 + rand() % 84;
+        ev[i].velocity = 1 + rand() % 127;
+        ev[i].on = (rand() % 10) < 6;
+    }
+
+    VoiceTracker* vt = createTracker(TRACKER_VOICES);
+    for (int c = 0; c < MIDI_CHANNELS; c++) trackerSetChannel(vt, c, 1, 8);
+    bool saved_trace = trace;
+    trace = false;
+
+    long long t0 = current_time_ns();
+    for (long i = 0; i < events; i++) {
+        if (ev[i].on) trackerNoteOn(vt, ev[i].ch, ev[i].note, ev[i].velocity);
+        else trackerNoteOff(vt, ev[i].ch, ev[i].note);
+    }
+    long long ns = current_time_ns() - t0;
+
+    printf("16 channels (reserve 1, limit 8), %d voices: %.1f ns/event %.2f Mevents/s  %lu steals\n",
+           TRACKER_VOICES, (double)ns / events, events * 1000.0 / ns, vt->steals);
+    trace = saved_trace;
+    free(vt);
+    free(ev);
+}
+
+#ifndef _WIN32
+// Standard MIDI File playback. The file is mmapped and decoded in place:
+// each track is a cursor over the mapping, variable-length quantities and
+// running status are decoded on the fly, and tracks are merged in time
+// order with a min-heap keyed on each track's next event tick.
+
+typedef struct {
+    const uint8_t* p;
+    const uint8_t* end;
+    uint64_t tick;                  // absolute tick of the pending event
+    uint8_t running;                // running status
+    // Pending (already decoded) event
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+    uint8_t meta;                   // meta type when status == 0xFF
+    const uint8_t* payload;         // meta/sysex payload
+    uint32_t length;
+    bool pending;                   // the fields above hold a valid event
+    bool done;                      // end of track reached
+} SmfTrack;
+
+typedef struct {
+    const uint8_t* map;
+    size_t size;
+    int format;
+    int ntracks;
+    int division;                   // ticks per quarter note
+    SmfTrack* tracks;
+    int* heap;                      // track indices, min-heap on pending tick
+    int heap_size;
+} SmfFile;
+
+typedef struct {
+    long events;
+    long note_ons;
+    long note_offs;
+    double seconds;                 // musical length of the file
+} SmfStats;
+
+static uint32_t be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static bool smfReadVlq(SmfTrack* t, uint32_t* out) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4 && t->p < t->end; i++) {
+        uint8_t b = *t->p++;
+        v = (v << 7) | (b & 0x7F);
+        if (!(b & 0x80)) {
+            *out = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Decodes the next event of a track into its pending slot. A truncated or
+// malformed track simply ends at the last good event.
+static void smfAdvance(SmfTrack* t) {
+    uint32_t delta, len;
+    t->pending = false;
+    if (t->done || t->p >= t->end || !smfReadVlq(t, &delta) || t->p >= t->end) {
+        t->done = true;
+        return;
+    }
+    t->tick += delta;
+
+    uint8_t b = *t->p;
+    if (b & 0x80) {
+        t->p++;
+        if (b < 0xF0) t->running = b;
+    } else if (t->running) {
+        b = t->running;             // running status: b is already data
+    } else {
+        t->done = true;             // data byte with no status to run on
+        return;
+    }
+    t->status = b;
+
+    if (b == 0xFF) {
+        if (t->p >= t->end) { t->done = true; return; }
+        t->meta = *t->p++;
+        if (!smfReadVlq(t, &len) || len > (uint32_t)(t->end - t->p)) { t->done = true; return; }
+        t->payload = t->p;
+        t->length = len;
+        t->p += len;
+        if (t->meta == 0x2F) {
+            t->done = true;                     // end of track
+            t->pending = true;
+            return;
+        }
+    } else if (b == 0xF0 || b == 0xF7) {
+        if (!smfReadVlq(t, &len) || len > (uint32_t)(t->end - t->p)) { t->done = true; return; }
+        t->payload = t->p;
+        t->length = len;
+        t->p += len;
+    } else {
+        int need = ((b & 0xF0) == 0xC0 || (b & 0xF0) == 0xD0) ? 1 : 2;
+        if (t->end - t->p < need) { t->done = true; return; }
+        t->data1 = t->p[0] & 0x7F;
+        t->data2 = need == 2 ? (t->p[1] & 0x7F) : 0;
+        t->p += need;
+    }
+    t->pending = true;
+}
+
+static bool smfHeapLess(SmfFile* f, int a, int b) {
+    const SmfTrack* ta = &f->tracks[f->heap[a]];
+    const SmfTrack* tb = &f->tracks[f->heap[b]];
+    return ta->tick < tb->tick || (ta->tick == tb->tick && f->heap[a] < f->heap[b]);
+}
+
+static void smfHeapDown(SmfFile* f, int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < f->heap_size && smfHeapLess(f, l, m)) m = l;
+        if (r < f->heap_size && smfHeapLess(f, r, m)) m = r;
+        if (m == i) return;
+        int tmp = f->heap[i];
+        f->heap[i] = f->heap[m];
+        f->heap[m] = tmp;
+        i = m;
+    }
+}
+
+// Rewinds every track and rebuilds the merge heap
+static void smfRewind(SmfFile* f) {
+    const uint8_t* p = f->map + 14;
+    f->heap_size = 0;
+    for (int i = 0; i < f->ntracks; i++) {
+        SmfTrack* t = &f->tracks[i];
+        memset(t, 0, sizeof(*t));
+        // Skip unknown chunks until the next MTrk
+        while (p + 8 <= f->map + f->size && memcmp(p, "MTrk", 4) != 0) p += 8 + be32(p + 4);
+        if (p + 8 > f->map + f->size) {
+            t->done = true;
+            continue;
+        }
+        uint32_t len = be32(p + 4);
+        t->p = p + 8;
+        t->end = (len <= (size_t)(f->map + f->size - t->p)) ? t->p + len : f->map + f->size;
+        p = t->end;
+        smfAdvance(t);
+        if (t->pending) f->heap[f->heap_size++] = i;
+    }
+    for (int i = f->heap_size / 2 - 1; i >= 0; i--) smfHeapDown(f, i);
+}
+
+int smfOpen(SmfFile* f, const char* path) {
+    memset(f, 0, sizeof(*f));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 14) {
+        fprintf(stderr, "%s: not a MIDI file\n", path);
+        close(fd);
+        return -1;
+    }
+    f->size = st.st_size;
+    f->map = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (f->map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    madvise((void*)f->map, f->size, MADV_SEQUENTIAL);
+
+    if (memcmp(f->map, "MThd", 4) != 0 || be32(f->map + 4) < 6) {
+        fprintf(stderr, "%s: missing MThd header\n", path);
+        munmap((void*)f->map, f->size);
+        return -1;
+    }
+    f->format = (f->map[8] << 8) | f->map[9];
+    f->ntracks = (f->map[10] << 8) | f->map[11];
+    int division = (f->map[12] << 8) | f->map[13];
+    if (division & 0x8000) {
+        // SMPTE: frames per second * ticks per frame, taken at 120 bpm
+        division = (256 - (division >> 8)) * (division & 0xFF) / 2;
+    }
+    f->division = division ? division : 96;
+
+    f->tracks = (SmfTrack*)calloc(f->ntracks ? f->ntracks : 1, sizeof(SmfTrack));
+    f->heap = (int*)calloc(f->ntracks ? f->ntracks : 1, sizeof(int));
+    smfRewind(f);
+    return 0;
+}
+
+void smfClose(SmfFile* f) {
+    munmap((void*)f->map, f->size);
+    free(f->tracks);
+    free(f->heap);
+}
+
+static void sleep_until_ns(long long deadline) {
+    long long now = monotonic_time_ns();
+    if (deadline <= now) return;
+    struct timespec ts = { (deadline - now) / 1000000000LL, (deadline - now) % 1000000000LL };
+    nanosleep(&ts, NULL);
+}
+
+// Plays the merged event stream into the tracker, either paced by the
+// file's tempo map or as fast as possible.
+void smfPlay(SmfFile* f, VoiceTracker* vt, bool realtime, SmfStats* stats) {
+    uint64_t tempo_tick = 0;
+    double tempo_us = 0.0;              // time at tempo_tick
+    double us_per_tick = 500000.0 / f->division;
+    long long start = monotonic_time_ns();
+    NoteEvent batch[BATCH_CHUNK];
+    int pending = 0;
+    uint64_t batch_tick = 0;
+    double batch_us = 0.0;
+
+    smfRewind(f);
+    while (f->heap_size > 0) {
+        SmfTrack* t = &f->tracks[f->heap[0]];
+        double at_us = tempo_us + (t->tick - tempo_tick) * us_per_tick;
+        uint8_t type = t->status & 0xF0, ch = t->status & 0x0F;
+
+        if (t->status == 0xFF && t->meta == 0x51 && t->length == 3) {
+            tempo_us = at_us;
+            tempo_tick = t->tick;
+            us_per_tick = (double)((t->payload[0] << 16) | (t->payload[1] << 8) | t->payload[2]) / f->division;
+        } else if (type == 0x90 || type == 0x80) {
+            // Notes on the same tick (chords, across tracks) go in as one batch
+            if (pending > 0 && (t->tick != batch_tick || pending == BATCH_CHUNK)) {
+                if (realtime) sleep_until_ns(start + (long long)(batch_us * 1000.0));
+                trackerStatsSetTime((uint64_t)(batch_us * 1000.0));
+                trackerApplyBatch(vt, batch, pending);
+                pending = 0;
+            }
+            batch_tick = t->tick;
+            batch_us = at_us;
+            NoteEvent* e = &batch[pending++];
+            e->channel = ch;
+            e->note = t->data1;
+            e->velocity = t->data2;
+            if (type == 0x90 && t->data2 > 0) {
+                e->type = NOTE_ON;
+                stats->note_ons++;
+            } else {
+                e->type = NOTE_OFF;
+                stats->note_offs++;
+            }
+        } else if (type == 0xB0 && (t->data1 == 120 || t->data1 == 123)) {
+            // All sound / all notes off
+            if (realtime && pending > 0) sleep_until_ns(start + (long long)(batch_us * 1000.0));
+            trackerStatsSetTime((uint64_t)(batch_us * 1000.0));
+            trackerApplyBatch(vt, batch, pending);
+            pending = 0;
+            Deque* dq = &vt->channels[ch].notes;
+            for (int n = nextHeldNote(dq, 0); n >= 0; n = nextHeldNote(dq, n + 1)) {
+                trackerNoteOff(vt, ch, n);
+            }
+        }
+        stats->events++;
+        stats->seconds = at_us / 1e6;
+
+        smfAdvance(t);
+        if (!t->pending) f->heap[0] = f->heap[--f->heap_size];
+        smfHeapDown(f, 0);
+    }
+    if (realtime && pending > 0) sleep_until_ns(start + (long long)(batch_us * 1000.0));
+    trackerStatsSetTime((uint64_t)(batch_us * 1000.0));
+    trackerApplyBatch(vt, batch, pending);
+}
+
+// --smf: play a file through a default 16-channel tracker
+int run_smf(const char* path, bool realtime, int passes) {
+    SmfFile f;
+    if (smfOpen(&f, path) != 0) return 1;
+    printf("%s: format %d, %d tracks, %d ticks/quarter\n", path, f.format, f.ntracks, f.division);
+
+    VoiceTracker* vt = createTracker(TRACKER_VOICES);
+    SmfStats stats = { 0 };
+    long long t0 = current_time_ns();
+    for (int pass = 0; pass < passes; pass++) {
+        initTracker(vt, TRACKER_VOICES);
+        smfPlay(&f, vt, realtime, &stats);
+    }
+    double secs = (current_time_ns() - t0) / 1e9;
+
+    printf("%ld events (%ld note-on, %ld note-off), %.1f s of music, %d pass(es) in %.3f s\n",
+           stats.events, stats.note_ons, stats.note_offs, stats.seconds, passes, secs);
+    printf("%.2f Mevents/s, %.2f M note events/s, %lu steals in the last pass\n",
+           stats.events / secs / 1e6, (stats.note_ons + stats.note_offs) / secs / 1e6, vt->steals);
+    free(vt);
+    smfClose(&f);
+    return 0;
+}
+#endif
+
+// Note events travel from the MIDI input thread to the audio render thread
+// through a wait-free single-producer/single-consumer ring. Each side owns
+// one index and keeps a cached copy of the other's on its own cache line,
+// so the common case touches no shared line at all.
+#define EVENT_RING_SIZE 1024        // power of two
+#define CACHE_LINE 64
+
+typedef struct {
+    _Alignas(CACHE_LINE) _Atomic uint32_t head;    // next slot to write (producer)
+    uint32_t tail_cache;                            // producer's view of tail
+    _Alignas(CACHE_LINE) _Atomic uint32_t tail;    // next slot to read (consumer)
+    uint32_t head_cache;                            // consumer's view of head
+    _Alignas(CACHE_LINE) NoteEvent events[EVENT_RING_SIZE];
+} EventRing;
+
+void initEventRing(EventRing* r) {
+    atomic_store_explicit(&r->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&r->tail, 0, memory_order_relaxed);
+    r->tail_cache = r->head_cache = 0;
+}
+
+// Producer side. Returns false (and drops the event) if the ring is full.
+bool eventRingPush(EventRing* r, const NoteEvent* ev) {
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head - r->tail_cache == EVENT_RING_SIZE) {
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (head - r->tail_cache == EVENT_RING_SIZE) return false;
+    }
+    r->events[head & (EVENT_RING_SIZE - 1)] = *ev;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    return true;
+}
+
+// Consumer side: the oldest event without removing it, or NULL if empty.
+const NoteEvent* eventRingPeek(EventRing* r) {
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    if (tail == r->head_cache) {
+        r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+        if (tail == r->head_cache) return NULL;
+    }
+    return &r->events[tail & (EVENT_RING_SIZE - 1)];
+}
+
+void eventRingPop(EventRing* r) {
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+}
+
+// Renders frames [from, to) of the current block with the voices as they
+// stand; the block processor calls it between events.
+typedef void (*RenderSegmentFunc)(VoiceTracker* vt, int from, int to, void* user);
+
+typedef struct {
+    uint64_t stream_start_ns;       // time of frame 0
+    uint64_t frame;                 // first frame of the next block
+    int sample_rate;
+    int latency_frames;             // events are played this far behind capture
+    long applied;
+    long late;                      // events that arrived after their frame
+} BlockClock;
+
+// Telemetry runs on stream time: frame `pos` of the current block
+static void blockStatsTime(BlockClock* clk, int pos) {
+    if (tracker_stats) trackerStatsSetTime((clk->frame + pos) * 1000000000ULL / clk->sample_rate);
+}
+
+// Called once per audio block on the render thread. Every event due before
+// the end of the block is applied at its own frame offset, with the audio
+// in between rendered by `render`; later events stay queued. No locks, no
+// allocation, no printing.
+void processBlock(VoiceTracker* vt, EventRing* ring, BlockClock* clk, int frames,
+                  RenderSegmentFunc render, void* user) {
+    int pos = 0, pending = 0;
+    NoteEvent batch[BATCH_CHUNK];       // events due at frame `pos`, applied together
+    const NoteEvent* ev;
+    while ((ev = eventRingPeek(ring)) != NULL) {
+        int64_t since_start = (int64_t)(ev->time_ns - clk->stream_start_ns);
+        int64_t at = since_start * clk->sample_rate / 1000000000LL
+                     + clk->latency_frames - (int64_t)clk->frame;
+        if (at >= frames) break;
+        if (at < pos) {
+            if (at < 0) clk->late++;
+            at = pos;
+        }
+        if (at > pos || pending == BATCH_CHUNK) {
+            blockStatsTime(clk, pos);
+            trackerApplyBatch(vt, batch, pending);
+            pending = 0;
+        }
+        if (render && at > pos) render(vt, pos, (int)at, user);
+        pos = (int)at;
+
+        batch[pending++] = *ev;
+        clk->applied++;
+        eventRingPop(ring);
+    }
+    blockStatsTime(clk, pos);
+    trackerApplyBatch(vt, batch, pending);
+    if (render && pos < frames) render(vt, pos, frames, user);
+    clk->frame += frames;
+}
+
+// Polyphonic render engine. The tracker decides which note plays on which
+// voice slot; the engine owns an oscillator and envelope per slot, kept SoA
+// and indexed by slot, and renders each block by walking the tracker's
+// dense active list, so free voices cost nothing. It plugs into
+// processBlock() as the RenderSegmentFunc and notices new notes (voice_age
+// changed) and releases (released bit set) as it goes. Channels run with
+// hold_releases, so a released note keeps its voice through the envelope
+// release and the engine hands it back with trackerVoiceFinished().
+#define SYNTH_MAX_BLOCK 1024
+#define SINE_TABLE_BITS 11
+#define SINE_TABLE_SIZE (1 << SINE_TABLE_BITS)
+#define SYNTH_VOICE_GAIN 0.15f      // headroom for a full chord before clipping
+#define SYNTH_SILENCE 1e-4f         // release ends below this level
+
+// The waveforms of bytebeater/wavegen.c, as phase accumulators
+typedef enum {
+    WAVE_SINE = 0,
+    WAVE_SQUARE,
+    WAVE_TRIANGLE,
+    WAVE_FM,
+    WAVE_COUNT
+} SynthWave;
+
+const char* synth_wave_names[WAVE_COUNT] = { "sine", "square", "triangle", "fm" };
+
+typedef enum { ENV_ATTACK = 0, ENV_DECAY, ENV_SUSTAIN, ENV_RELEASE } EnvStage;
+
+static float sine_table[SINE_TABLE_SIZE + 1];   // one extra point for interpolation
+
+typedef struct {
+    VoiceTracker* vt;
+    int sample_rate;
+    SynthWave wave;
+    float attack_step;              // linear attack, per frame
+    float decay_coeff;              // exponential decay towards sustain
+    float sustain;
+    float release_coeff;            // exponential release towards silence
+    float fm_index;                 // FM: modulator depth in radians, modulator at half the carrier
+    uint32_t note_inc[MIDI_NOTES];  // phase increment per frame for each note
+
+    // Per voice slot
+    uint32_t phase[TRACKER_VOICES];
+    uint32_t mod_phase[TRACKER_VOICES];
+    uint32_t inc[TRACKER_VOICES];
+    float gain[TRACKER_VOICES];
+    float level[TRACKER_VOICES];
+    uint8_t stage[TRACKER_VOICES];
+    uint32_t age[TRACKER_VOICES];   // tracker voice_age the state above belongs to
+    bool live[TRACKER_VOICES];
+
+    float mix[SYNTH_MAX_BLOCK];
+    long voice_frames;
+} Synth;
+
+// Envelope times in seconds
+void initSynth(Synth* s, VoiceTracker* vt, int sample_rate, SynthWave wave,
+               float attack, float decay, float sustain, float release) {
+    memset(s, 0, sizeof(*s));
+    s->vt = vt;
+    s->sample_rate = sample_rate;
+    s->wave = wave;
+    s->attack_step = 1.0f / (attack * sample_rate + 1.0f);
+    s->decay_coeff = expf(-1.0f / (decay * sample_rate + 1.0f));
+    s->sustain = sustain;
+    s->release_coeff = expf(-1.0f / (release * sample_rate / 9.2f + 1.0f));  // ~-80 dB after `release`
+    s->fm_index = 5.0f;
+    for (int i = 0; i <= SINE_TABLE_SIZE; i++) sine_table[i] = sinf(2.0f * (float)M_PI * i / SINE_TABLE_SIZE);
+    for (int n = 0; n < MIDI_NOTES; n++) {
+        double hz = 440.0 * pow(2.0, (n - 69) / 12.0);
+        s->note_inc[n] = (uint32_t)(hz / sample_rate * 4294967296.0);
+    }
+    for (int c = 0; c < MIDI_CHANNELS; c++) {
+        Deque* dq = &vt->channels[c].notes;
+        trackerSetPolicy(vt, c, dq->policy, dq->protect_bass, true);
+    }
+}
+
+static inline float sineLookup(uint32_t phase) {
+    uint32_t i = phase >> (32 - SINE_TABLE_BITS);
+    float frac = (phase << SINE_TABLE_BITS) * (1.0f / 4294967296.0f);
+    return sine_table[i] + (sine_table[i + 1] - sine_table[i]) * frac;
+}
+
+// Brings the slot's state in line with the tracker: a new note restarts
+// the oscillator and envelope, a release or a retrigger changes stage.
+static void synthSyncVoice(Synth* s, int slot) {
+    VoiceTracker* vt = s->vt;
+    if (!s->live[slot] || s->age[slot] != vt->voice_age[slot]) {
+        s->live[slot] = true;
+        s->age[slot] = vt->voice_age[slot];
+        s->phase[slot] = s->mod_phase[slot] = 0;
+        s->inc[slot] = s->note_inc[vt->voice_note[slot]];
+        s->gain[slot] = SYNTH_VOICE_GAIN * vt->voice_velocity[slot] / 127.0f;
+        s->level[slot] = 0.0f;
+        s->stage[slot] = ENV_ATTACK;
+    }
+    bool released = noteReleased(&vt->channels[vt->voice_channel[slot]].notes, vt->voice_note[slot]);
+    if (released) s->stage[slot] = ENV_RELEASE;
+    else if (s->stage[slot] == ENV_RELEASE) s->stage[slot] = ENV_ATTACK;
+}
+
+// Renders one voice into mix[from, to). Returns false once its release has
+// faded out.
+static bool synthRenderVoice(Synth* s, int slot, int from, int to) {
+    uint32_t phase = s->phase[slot], mod_phase = s->mod_phase[slot], inc = s->inc[slot];
+    float level = s->level[slot], gain = s->gain[slot];
+    int stage = s->stage[slot];
+    const float fm_scale = s->fm_index * (4294967296.0f / (2.0f * (float)M_PI));
+    float* mix = s->mix;
+
+    for (int f = from; f < to; f++) {
+        switch (stage) {
+            case ENV_ATTACK:
+                level += s->attack_step;
+                if (level >= 1.0f) { level = 1.0f; stage = ENV_DECAY; }
+                break;
+            case ENV_DECAY:
+                level = s->sustain + (level - s->sustain) * s->decay_coeff;
+                if (level - s->sustain < SYNTH_SILENCE) { level = s->sustain; stage = ENV_SUSTAIN; }
+                break;
+            case ENV_SUSTAIN:
+                break;
+            case ENV_RELEASE:
+                level *= s->release_coeff;
+                break;
+        }
+
+        float out;
+        switch (s->wave) {
+            case WAVE_SQUARE:
+                out = phase < 0x80000000u ? 1.0f : -1.0f;
+                break;
+            case WAVE_TRIANGLE:
+                out = 4.0f * fabsf(phase * (1.0f / 4294967296.0f) - 0.5f) - 1.0f;
+                break;
+            case WAVE_FM:
+                out = sineLookup(phase + (uint32_t)(int32_t)(fm_scale * sineLookup(mod_phase)));
+                mod_phase += inc >> 1;
+                break;
+            case WAVE_SINE:
+            default:
+                out = sineLookup(phase);
+                break;
+        }
+        mix[f] += out * level * gain;
+        phase += inc;
+    }
+
+    s->phase[slot] = phase;
+    s->mod_phase[slot] = mod_phase;
+    s->level[slot] = level;
+    s->stage[slot] = (uint8_t)stage;
+    return !(stage == ENV_RELEASE && level < SYNTH_SILENCE);
+}
+
+// RenderSegmentFunc for processBlock()
+static void synth_segment(VoiceTracker* vt, int from, int to, void* user) {
+    Synth* s = (Synth*)user;
+    int16_t finished[TRACKER_VOICES];
+    int nfinished = 0;
+
+    for (int i = 0; i < vt->active_count; i++) {
+        int16_t slot = vt->active[i];
+        synthSyncVoice(s, slot);
+        if (!synthRenderVoice(s, slot, from, to)) finished[nfinished++] = slot;
+    }
+    s->voice_frames += (long)(to - from) * vt->active_count;
+
+    // Freeing reorders the active list, so only after the walk
+    for (int i = 0; i < nfinished; i++) {
+        s->live[finished[i]] = false;
+        trackerVoiceFinished(vt, finished[i]);
+    }
+}
+
+// Applies the block's events from the ring and renders `frames` (at most
+// SYNTH_MAX_BLOCK) frames of 16-bit PCM into out.
+void synthRenderBlock(Synth* s, EventRing* ring, BlockClock* clk, int frames, int16_t* out) {
+    memset(s->mix, 0, frames * sizeof(float));
+    processBlock(s->vt, ring, clk, frames, synth_segment, s);
+    for (int f = 0; f < frames; f++) {
+        float v = s->mix[f] * 32767.0f;
+        out[f] = (int16_t)(v > 32767.0f ? 32767.0f : v < -32768.0f ? -32768.0f : v);
+    }
+}
+
+#define SYNTH_SAMPLE_RATE 48000
+#define SYNTH_BLOCK 256
+
+// --synth: a chord progression with a bass line, rendered offline through
+// the ring and the block engine as raw 16-bit mono PCM at 48 kHz.
+int run_synth(SynthWave wave, double seconds, const char* path) {
+    FILE* out = (path && strcmp(path, "-") != 0) ? fopen(path, "wb") : stdout;
+    if (!out) {
+        perror(path);
+        return 1;
+    }
+    static EventRing ring;
+    static Synth synth;
+    initEventRing(&ring);
+    VoiceTracker* vt = createTracker(TRACKER_VOICES);
+    trackerSetChannel(vt, 1, 1, 2);     // bass, room for one note in release
+    initSynth(&synth, vt, SYNTH_SAMPLE_RATE, wave, 0.01f, 0.3f, 0.6f, 0.4f);
+    for (int c = 0; c < MIDI_CHANNELS; c++) trackerSetPolicy(vt, c, STEAL_RELEASED, false, true);
+    BlockClock clk = { .stream_start_ns = 0, .sample_rate = SYNTH_SAMPLE_RATE };
+    bool saved_trace = trace;
+    trace = false;
+
+    static const int roots[4] = { 57, 53, 48, 55 };                 // Am F C G
+    static const int shapes[4][4] = { { 0, 3, 7, 12 }, { 0, 4, 7, 12 }, { 0, 4, 7, 12 }, { 0, 4, 7, 11 } };
+    const uint64_t step_ns = 500000000ULL;                          // a chord every half second
+    int chord[4] = { -1, -1, -1, -1 }, bass = -1;
+    long step = 0;
+
+    int16_t pcm[SYNTH_BLOCK];
+    long blocks = (long)(seconds * SYNTH_SAMPLE_RATE / SYNTH_BLOCK);
+    for (long b = 0; b < blocks; b++) {
+        uint64_t block_end_ns = (uint64_t)(b + 1) * SYNTH_BLOCK * 1000000000ULL / SYNTH_SAMPLE_RATE;
+        while (step * step_ns < block_end_ns) {
+            // Release the last chord just before the next one starts
+            uint64_t t = step * step_ns;
+            for (int i = 0; i < 4 && chord[i] >= 0; i++) {
+                NoteEvent off = { .time_ns = t > step_ns / 8 ? t - step_ns / 8 : 0, .type = NOTE_OFF, .channel = 0, .note = chord[i] };
+                eventRingPush(&ring, &off);
+            }
+            int root = roots[(step / 4) % 4];
+            for (int i = 0; i < 4; i++) {
+                chord[i] = root + shapes[(step / 4) % 4][i];
+                NoteEvent on = { .time_ns = t, .type = NOTE_ON, .channel = 0, .note = chord[i], .velocity = 60 + rand() % 40 };
+                eventRingPush(&ring, &on);
+            }
+            if (step % 2 == 0) {
+                if (bass >= 0) {
+                    NoteEvent off = { .time_ns = t, .type = NOTE_OFF, .channel = 1, .note = bass };
+                    eventRingPush(&ring, &off);
+                }
+                bass = root - 24 + (step % 4 == 2 ? 7 : 0);
+                NoteEvent on = { .time_ns = t, .type = NOTE_ON, .channel = 1, .note = bass, .velocity = 110 };
+                eventRingPush(&ring, &on);
+            }
+            step++;
+        }
+        synthRenderBlock(&synth, &ring, &clk, SYNTH_BLOCK, pcm);
+        fwrite(pcm, sizeof(int16_t), SYNTH_BLOCK, out);
+    }
+
+    trace = saved_trace;
+    fprintf(stderr, "%ld blocks of %d frames, %ld events, %ld voice-frames, %lu steals\n",
+            blocks, SYNTH_BLOCK, clk.applied, synth.voice_frames, vt->steals);
+    if (out != stdout) fclose(out);
+    free(vt);
+    return 0;
+}
+
+// --synth-bench: every voice held, how many of them one core could render
+// in real time.
+void run_synth_benchmark(SynthWave wave, double seconds) {
+    static EventRing ring;
+    static Synth synth;
+    initEventRing(&ring);
+    VoiceTracker* vt = createTracker(TRACKER_VOICES);
+    initSynth(&synth, vt, SYNTH_SAMPLE_RATE, wave, 0.01f, 0.3f, 0.6f, 0.4f);
+    BlockClock clk = { .stream_start_ns = 0, .sample_rate = SYNTH_SAMPLE_RATE };
+    bool saved_trace = trace;
+    trace = false;
+    for (int v = 0; v < TRACKER_VOICES; v++) trackerNoteOn(vt, v % MIDI_CHANNELS, 36 + v * 2, 64 + v);
+
+    int16_t pcm[SYNTH_BLOCK];
+    long blocks = (long)(seconds * SYNTH_SAMPLE_RATE / SYNTH_BLOCK);
+    long long t0 = monotonic_time_ns();
+    for (long b = 0; b < blocks; b++) synthRenderBlock(&synth, &ring, &clk, SYNTH_BLOCK, pcm);
+    double secs = (monotonic_time_ns() - t0) / 1e9;
+    trace = saved_trace;
+
+    double audio = (double)blocks * SYNTH_BLOCK / SYNTH_SAMPLE_RATE;
+    printf("%-8s %d voices, %.1f s of audio in %.3f s: %.1f ns/voice-frame, %.0f voices in real time per core\n",
+           synth_wave_names[wave], vt->active_count, audio, secs, secs * 1e9 / synth.voice_frames,
+           synth.voice_frames / (double)SYNTH_SAMPLE_RATE / secs);
+    free(vt);
+}
+
+#ifndef _WIN32
+// --threads: a MIDI input thread feeds random notes through the ring while
+// a render thread runs 256-frame blocks at 48 kHz on a simulated audio clock.
+#define DEMO_SAMPLE_RATE 48000
+#define DEMO_BLOCK 256
+
+typedef struct {
+    EventRing* ring;
+    atomic_bool running;
+    long sent;
+    long dropped;
+} MidiInputDemo;
+
+static void* midi_input_thread(void* arg) {
+    MidiInputDemo* in = (MidiInputDemo*)arg;
+    unsigned seed = 7;
+    while (atomic_load(&in->running)) {
+        NoteEvent ev = {
+            .time_ns = monotonic_time_ns(),
+            .type = (rand_r(&seed) % 10) < 6 ? NOTE_ON : NOTE_OFF,
+            .channel = rand_r(&seed) % MIDI_CHANNELS,
+            .note = 36 + rand_r(&seed) % 48,
+            .velocity = 1 + rand_r(&seed) % 127,
+        };
+        if (eventRingPush(in->ring, &ev)) in->sent++;
+        else in->dropped++;
+        struct timespec gap = { 0, 200000 + rand_r(&seed) % 800000 };    // 0.2-1 ms
+        nanosleep(&gap, NULL);
+    }
+    return NULL;
+}
+
+static void count_segment(VoiceTracker* vt, int from, int to, void* user) {
+    *(long*)user += (long)(to - from) * vt->active_count;  // voice-frames to render
+}
+
+void run_thread_demo(double seconds) {
+    static EventRing ring;
+    initEventRing(&ring);
+    VoiceTracker* vt = createTracker(TRACKER_VOICES);
+    MidiInputDemo in = { .ring = &ring, .running = true };
+    BlockClock clk = {
+        .stream_start_ns = monotonic_time_ns(),
+        .sample_rate = DEMO_SAMPLE_RATE,
+        .latency_frames = DEMO_BLOCK,
+    };
+    bool saved_trace = trace;
+    trace = false;
+
+    pthread_t tid;
+    pthread_create(&tid, NULL, midi_input_thread, &in);
+
+    long voice_frames = 0, blocks = 0;
+    long long block_ns = 1000000000LL * DEMO_BLOCK / DEMO_SAMPLE_RATE;
+    long long worst_ns = 0;
+    while (clk.frame < (uint64_t)(seconds * DEMO_SAMPLE_RATE)) {
+        // Wait for the "audio interrupt" at the end of this block's period
+        sleep_until_ns(clk.stream_start_ns + (blocks + 1) * block_ns);
+        long long t0 = monotonic_time_ns();
+        processBlock(vt, &ring, &clk, DEMO_BLOCK, count_segment, &voice_frames);
+        long long took = monotonic_time_ns() - t0;
+        if (took > worst_ns) worst_ns = took;
+        blocks++;
+    }
+
+    atomic_store(&in.running, false);
+    pthread_join(tid, NULL);
+    trace = saved_trace;
+
+    printf("%ld blocks of %d frames: %ld events sent, %ld applied, %ld late, %ld dropped (ring full)\n",
+           blocks, DEMO_BLOCK, in.sent, clk.applied, clk.late, in.dropped);
+    printf("worst block: %.1f us of a %.1f us period, %ld voice-frames scheduled, %lu steals\n",
+           worst_ns / 1000.0, block_ns / 1000.0, voice_frames, vt->steals);
+    free(vt);
+}
+#endif
+
+#ifndef _WIN32
+// Live MIDI 1.0 input as a raw byte stream from any file descriptor:
+// stdin, a FIFO, or a pty standing in for a device. Input is read in large
+// chunks and parsed in place; note messages are gathered into batches for
+// trackerApplyBatch(), so there is no syscall or tracker call per byte.
+#define MIDI_READ_CHUNK 65536
+
+typedef struct {
+    uint8_t status;                 // running status, 0 when there is none
+    uint8_t data[2];
+    uint8_t count;                  // data bytes collected so far
+    uint8_t need;                   // data bytes the current message takes
+    bool in_sysex;
+    long bytes;
+    long messages;                  // complete channel and system common messages
+    long notes;
+    long realtime;
+    long sysex;
+    long stray;                     // data bytes with no status to belong to
+} MidiParser;
+
+void initMidiParser(MidiParser* p) {
+    memset(p, 0, sizeof(*p));
+}
+
+// Data bytes taken by a channel or system common status byte
+static uint8_t midiDataLength(uint8_t status) {
+    switch (status & 0xF0) {
+        case 0xC0:
+        case 0xD0:
+            return 1;
+        case 0xF0:
+            return status == 0xF2 ? 2 : (status == 0xF1 || status == 0xF3) ? 1 : 0;
+        default:
+            return 2;
+    }
+}
+
+// Parses a chunk, carrying partial messages over to the next one.
+void midiParse(MidiParser* p, VoiceTracker* vt, const uint8_t* buf, size_t len) {
+    NoteEvent batch[BATCH_CHUNK];
+    int pending = 0;
+    p->bytes += len;
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t b = buf[i];
+        if (b >= 0xF8) {
+            // Realtime (clock, start, stop...) may appear anywhere, even
+            // mid-message or inside SysEx, and changes nothing
+            p->realtime++;
+            continue;
+        }
+        if (b & 0x80) {
+            if (p->in_sysex) {
+                p->in_sysex = false;        // F7, or any status, ends SysEx
+                p->sysex++;
+                if (b == 0xF7) continue;
+            }
+            if (b == 0xF0) {
+                p->in_sysex = true;
+                p->status = 0;
+                continue;
+            }
+            p->count = 0;
+            p->need = midiDataLength(b);
+            if (b >= 0xF0) {
+                // System common cancels running status
+                p->status = p->need ? b : 0;
+                if (!p->need) p->messages++;
+            } else {
+                p->status = b;
+            }
+            continue;
+        }
+        if (p->in_sysex) continue;
+        if (!p->status) {
+            p->stray++;
+            continue;
+        }
+
+        p->data[p->count++] = b;
+        if (p->count < p->need) continue;
+        p->count = 0;
+        p->messages++;
+
+        uint8_t type = p->status & 0xF0;
+        if (type == 0x90 || type == 0x80) {
+            NoteEvent* e = &batch[pending++];
+            e->type = (type == 0x90 && p->data[1] > 0) ? NOTE_ON : NOTE_OFF;
+            e->channel = p->status & 0x0F;
+            e->note = p->data[0];
+            e->velocity = p->data[1];
+            p->notes++;
+            if (pending == BATCH_CHUNK) {
+                trackerApplyBatch(vt, batch, pending);
+                pending = 0;
+            }
+        }
+        if (p->status >= 0xF0) p->status = 0;  // no running status for system common
+    }
+    trackerApplyBatch(vt, batch, pending);
+}
+
+// Reads fd to end of file. Returns -1 on a read error.
+int midiReadStream(int fd, MidiParser* p, VoiceTracker* vt) {
+    static uint8_t buf[MIDI_READ_CHUNK];
+    for (;;) {
+        ssize_t got = read(fd, buf, sizeof(buf));
+        if (got == 0) return 0;
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        midiParse(p, vt, buf, (size_t)got);
+    }
+}
+
+static void print_midi_stats(const MidiParser* p) {
+    printf("%ld bytes: %ld messages (%ld notes), %ld realtime, %ld SysEx, %ld stray data bytes\n",
+           p->bytes, p->messages, p->notes, p->realtime, p->sysex, p->stray);
+}
+
+// --midi-in [path]: drive a 16-channel tracker from raw MIDI (stdin by default)
+int run_midi_in(const char* path) {
+    int fd = (path && strcmp(path, "-") != 0) ? open(path, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    VoiceTracker* vt = createTracker(TRACKER_VOICES);
+    MidiParser p;
+    initMidiParser(&p);
+    int rc = midiReadStream(fd, &p, vt);
+    if (rc != 0) perror("read");
+    if (fd != STDIN_FILENO) close(fd);
+    print_midi_stats(&p);
+    print_tracker_contents(vt);
+    free(vt);
+    return rc != 0;
+}
+
+// A synthetic stream that exercises the parser: note on/off pairs mostly
+// in running status, realtime clock bytes wedged into messages, the
+// occasional SysEx dump and controller change.
+static size_t make_midi_stream(uint8_t* out, size_t size) {
+    unsigned seed = 11;
+    size_t n = 0;
+    while (n + 64 < size) {
+        int r = rand_r(&seed) % 100;
+        uint8_t ch = rand_r(&seed) % MIDI_CHANNELS;
+        if (r < 2) {
+            out[n++] = 0xF0;
+            for (int k = rand_r(&seed) % 32; k > 0; k--) out[n++] = rand_r(&seed) & 0x7F;
+            out[n++] = 0xF7;
+        } else if (r < 6) {
+            out[n++] = 0xB0 | ch;
+            out[n++] = rand_r(&seed) % 120;
+            out[n++] = rand_r(&seed) & 0x7F;
+        } else {
+            out[n++] = 0x90 | ch;
+            for (int k = 1 + rand_r(&seed) % 4; k > 0; k--) {
+                out[n++] = 24 + rand_r(&seed) % 84;
+                if (rand_r(&seed) % 8 == 0) out[n++] = 0xF8;
+                out[n++] = rand_r(&seed) % 3 ? 1 + rand_r(&seed) % 127 : 0;     // velocity 0 = off
+            }
+        }
+    }
+    return n;
+}
+
+typedef struct {
+    int fd;
+    const uint8_t* data;
+    size_t size;
+    int passes;
+} MidiPipeWriter;
+
+static void* midi_pipe_writer(void* arg) {
+    MidiPipeWriter* w = (MidiPipeWriter*)arg;
+    for (int pass = 0; pass < w->passes; pass++) {
+        for (size_t off = 0; off < w->size; ) {
+            ssize_t put = write(w->fd, w->data + off, w->size - off);
+            if (put < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            off += (size_t)put;
+        }
+    }
+    close(w->fd);
+    return NULL;
+}
+
+// --midi-bench [MB]: parse rate from memory, then through a pipe from
+// another thread with chunked reads.
+void run_midi_benchmark(double megabytes) {
+    size_t size = (size_t)(megabytes * 1048576.0);
+    uint8_t* stream = (uint8_t*)malloc(size);
+    size = make_midi_stream(stream, size);
+    VoiceTracker* vt = createTracker(TRACKER_VOICES);
+    bool saved_trace = trace;
+    trace = false;
+
+    MidiParser p;
+    initMidiParser(&p);
+    long long t0 = monotonic_time_ns();
+    for (size_t off = 0; off < size; off += MIDI_READ_CHUNK) {
+        midiParse(&p, vt, stream + off, size - off < MIDI_READ_CHUNK ? size - off : MIDI_READ_CHUNK);
+    }
+    double secs = (monotonic_time_ns() - t0) / 1e9;
+    print_midi_stats(&p);
+    printf("memory: %.1f MB/s, %.2f M messages/s\n", p.bytes / secs / 1048576.0, p.messages / secs / 1e6);
+
+    int fds[2];
+    if (pipe(fds) == 0) {
+        MidiPipeWriter w = { .fd = fds[1], .data = stream, .size = size, .passes = 1 };
+        initTracker(vt, TRACKER_VOICES);
+        initMidiParser(&p);
+        pthread_t tid;
+        t0 = monotonic_time_ns();
+        pthread_create(&tid, NULL, midi_pipe_writer, &w);
+        midiReadStream(fds[0], &p, vt);
+        secs = (monotonic_time_ns() - t0) / 1e9;
+        pthread_join(tid, NULL);
+        close(fds[0]);
+        printf("pipe:   %.1f MB/s, %.2f M messages/s\n", p.bytes / secs / 1048576.0, p.messages / secs / 1e6);
+    }
+
+    trace = saved_trace;
+    free(vt);
+    free(stream);
+}
+#endif
+
+#ifndef _WIN32
+// --replay: re-drive a tracker from a recording's inputs as fast as
+// possible, checking every allocation decision against the recorded one.
+int run_replay(const char* path) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        return 1;
+    }
+    const uint8_t* map = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "%s: cannot map recording\n", path);
+        return 1;
+    }
+    const RecordHeader* h = (const RecordHeader*)map;
+    if ((size_t)st.st_size < sizeof(*h) || memcmp(h->magic, RECORD_MAGIC, 4) != 0 ||
+        h->version != RECORD_VERSION || h->record_size != sizeof(EventRecord)) {
+        fprintf(stderr, "%s: not a version %d voice tracker recording\n", path, RECORD_VERSION);
+        munmap((void*)map, st.st_size);
+        return 1;
+    }
+
+    static Recorder verify;
+    memset(&verify, 0, sizeof(verify));
+    verify.expect = (const EventRecord*)(map + sizeof(*h));
+    verify.count = (st.st_size - sizeof(*h)) / sizeof(EventRecord);
+
+    VoiceTracker* vt = (VoiceTracker*)malloc(sizeof(VoiceTracker));
+    Deque* dq = NULL;               // set once a standalone Deque run starts
+    bool saved_trace = trace;
+    trace = false;
+    recorder = &verify;
+    initTracker(vt, TRACKER_VOICES);
+
+    long inputs = 0;
+    long long t0 = monotonic_time_ns();
+    while (verify.cursor < verify.count) {
+        const EventRecord* r = &verify.expect[verify.cursor++];
+        inputs++;
+        switch (r->kind) {
+            case REC_RESET:
+                initTracker(vt, r->arg);
+                break;
+            case REC_CHANNEL:
+                trackerSetChannel(vt, r->channel, r->note, r->velocity);
+                break;
+            case REC_POLICY:
+                trackerSetPolicy(vt, r->channel, (StealPolicy)r->note,
+                                 r->velocity & REC_FLAG_PROTECT_BASS, r->velocity & REC_FLAG_HOLD_RELEASES);
+                break;
+            case REC_DEQUE:
+                if (!dq) dq = createDeque();
+                initDeque(dq);
+                dq->policy = (StealPolicy)r->note;
+                dq->protect_bass = r->velocity & REC_FLAG_PROTECT_BASS;
+                dq->hold_releases = r->velocity & REC_FLAG_HOLD_RELEASES;
+                break;
+            case REC_NOTE_ON:
+                if (dq) noteOnVelocity(dq, r->note, r->velocity);
+                else trackerNoteOn(vt, r->channel, r->note, r->velocity);
+                break;
+            case REC_NOTE_OFF:
+                if (dq) noteOff(dq, r->note);
+                else trackerNoteOff(vt, r->channel, r->note);
+                break;
+            case REC_VOICE_FINISHED:
+                if (dq) voiceFinished(dq, r->note);
+                else trackerVoiceFinished(vt, r->slot);
+                break;
+            default:
+                // A recorded decision the replay did not make
+                inputs--;
+                if (verify.mismatches++ < 10) {
+                    printf("Mismatch at record %ld: recorded %s ch %d note %d slot %d was not replayed\n",
+                           verify.cursor - 1, record_kind_name(r->kind), r->channel + 1, r->note, r->slot);
+                }
+                break;
+        }
+    }
+    double secs = (monotonic_time_ns() - t0) / 1e9;
+    recorder = NULL;
+    trace = saved_trace;
+
+    printf("%s: %ld records, %ld inputs replayed in %.3f s (%.2f Minputs/s), %ld decisions, %ld mismatches\n",
+           path, verify.count, inputs, secs, inputs / secs / 1e6, verify.decisions, verify.mismatches);
+    free(vt);
+    free(dq);
+    munmap((void*)map, st.st_size);
+    return verify.mismatches ? 1 : 0;
+}
+#endif
+
+// The exported C ABI (voice_tracker.h): thin wrappers over the core above
+struct vt_deque { Deque dq; };
+struct vt_tracker { VoiceTracker vt; };
+
+_Static_assert(sizeof(vt_event) == sizeof(NoteEvent), "vt_event must match NoteEvent");
+
+static int policy_by_name(const char* name) {
+    for (int p = 0; p < STEAL_POLICY_COUNT; p++) {
+        if (name && strcmp(name, steal_policy_names[p]) == 0) return p;
+    }
+    return -1;
+}
+
+VT_API int vt_abi_version(void) { return VT_ABI_VERSION; }
+VT_API void vt_set_trace(int on) { trace = on != 0; }
+
+VT_API vt_deque* vt_deque_new(void) {
+    vt_deque* d = (vt_deque*)malloc(sizeof(vt_deque));
+    if (d) initDeque(&d->dq);
+    return d;
+}
+
+VT_API void vt_deque_free(vt_deque* d) { free(d); }
+
+VT_API int vt_deque_set_policy(vt_deque* d, const char* policy, int protect_bass, int hold_releases) {
+    int p = policy_by_name(policy);
+    if (p < 0) return -1;
+    d->dq.policy = (StealPolicy)p;
+    d->dq.protect_bass = protect_bass != 0;
+    d->dq.hold_releases = hold_releases != 0;
+    return 0;
+}
+
+VT_API void vt_note_on(vt_deque* d, int note, int velocity) { noteOnVelocity(&d->dq, note, velocity); }
+VT_API void vt_note_off(vt_deque* d, int note) { noteOff(&d->dq, note); }
+VT_API void vt_voice_finished(vt_deque* d, int note) { voiceFinished(&d->dq, note); }
+VT_API int vt_held_count(vt_deque* d) { return d->dq.size; }
+VT_API unsigned long vt_deque_steals(vt_deque* d) { return d->dq.steals; }
+
+VT_API int vt_held_notes(vt_deque* d, int* notes, int max) {
+    int count = 0;
+    for (int16_t n = d->dq.front; n != NIL && count < max; n = d->dq.nodes[n].next) {
+        notes[count++] = d->dq.nodes[n].note;
+    }
+    return count;
+}
+
+VT_API vt_tracker* vt_tracker_new(int budget) {
+    vt_tracker* t = (vt_tracker*)malloc(sizeof(vt_tracker));
+    if (t) initTracker(&t->vt, budget);
+    return t;
+}
+
+VT_API void vt_tracker_free(vt_tracker* t) { free(t); }
+
+VT_API int vt_tracker_set_channel(vt_tracker* t, int ch, int reserve, int limit) {
+    return trackerSetChannel(&t->vt, ch, reserve, limit);
+}
+
+VT_API int vt_tracker_set_policy(vt_tracker* t, int ch, const char* policy, int protect_bass, int hold_releases) {
+    int p = policy_by_name(policy);
+    if (p < 0 || ch < 0 || ch >= MIDI_CHANNELS) return -1;
+    trackerSetPolicy(&t->vt, ch, (StealPolicy)p, protect_bass != 0, hold_releases != 0);
+    return 0;
+}
+
+VT_API int vt_tracker_note_on(vt_tracker* t, int ch, int note, int velocity) {
+    return trackerNoteOn(&t->vt, ch, note, velocity);
+}
+
+VT_API void vt_tracker_note_off(vt_tracker* t, int ch, int note) { trackerNoteOff(&t->vt, ch, note); }
+VT_API void vt_tracker_voice_finished(vt_tracker* t, int slot) { trackerVoiceFinished(&t->vt, slot); }
+
+VT_API int vt_tracker_apply(vt_tracker* t, const vt_event* events, int n) {
+    return trackerApplyBatch(&t->vt, (const NoteEvent*)events, n);
+}
+
+VT_API int vt_tracker_active(vt_tracker* t, int* slots, int max) {
+    int count = t->vt.active_count < max ? t->vt.active_count : max;
+    for (int i = 0; i < count; i++) slots[i] = t->vt.active[i];
+    return t->vt.active_count;
+}
+
+VT_API int vt_tracker_voice(vt_tracker* t, int slot, int* ch, int* note, int* velocity) {
+    if (slot < 0 || slot >= TRACKER_VOICES || t->vt.voice_channel[slot] < 0) return -1;
+    *ch = t->vt.voice_channel[slot];
+    *note = t->vt.voice_note[slot];
+    *velocity = t->vt.voice_velocity[slot];
+    return 0;
+}
+
+VT_API unsigned long vt_tracker_steals(vt_tracker* t) { return t->vt.steals; }
+
+#ifndef VOICE_TRACKER_LIB
+// Command line helpers, not part of the library build
+static bool parse_wave(const char* name, SynthWave* wave) {
+    for (int w = 0; w < WAVE_COUNT; w++) {
+        if (strcmp(name, synth_wave_names[w]) == 0) {
+            *wave = (SynthWave)w;
+            return true;
+        }
+    }
+    fprintf(stderr, "Unknown wave '%s' (sine, square, triangle, fm)\n", name);
+    return false;
+}
+
+static void close_recorder_at_exit(void) {
+    if (recorder && recorder->out) recorderClose(recorder);
+}
+
+static const char* stats_path = NULL;
+
+static void write_stats_at_exit(void) {
+    if (tracker_stats) trackerStatsWrite(tracker_stats, stats_path);
+}
+
+int main(int argc, char* argv[]) {
+    Deque* dq = createDeque();
+    int cnt = 0;
+    static Recorder rec;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            // Records whichever tracker run follows on the command line
+            if (recorderOpen(&rec, argv[++i]) != 0) return 1;
+            recorder = &rec;
+            atexit(close_recorder_at_exit);
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            // Telemetry for whichever tracker run follows, written on exit
+            static TrackerStats stats;
+            initTrackerStats(&stats);
+            tracker_stats = &stats;
+            stats_path = argv[++i];
+            atexit(write_stats_at_exit);
+        } else if (strcmp(argv[i], "--stats-dump") == 0 && i + 1 < argc) {
+            static TrackerStats stats;
+            if (trackerStatsRead(&stats, argv[i + 1]) != 0) return 1;
+            trackerStatsJson(&stats, stdout);
+            freeDeque(dq);
+            return 0;
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            long events = i + 1 < argc ? atol(argv[i + 1]) : 1000000;
+            run_policy_benchmark(events);
+            run_channel_benchmark(events);
+            freeDeque(dq);
+            return 0;
+#ifndef _WIN32
+        } else if (strcmp(argv[i], "--smf") == 0 && i + 1 < argc) {
+            // --smf file [--fast]: real time (traced) unless --fast
+            bool fast = i + 2 < argc && strcmp(argv[i + 2], "--fast") == 0;
+            trace = !fast;
+            freeDeque(dq);
+            return run_smf(argv[i + 1], !fast, 1);
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            freeDeque(dq);
+            return run_replay(argv[i + 1]);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            freeDeque(dq);
+            run_thread_demo(i + 1 < argc ? atof(argv[i + 1]) : 2.0);
+            return 0;
+        } else if (strcmp(argv[i], "--midi-in") == 0) {
+            freeDeque(dq);
+            return run_midi_in(i + 1 < argc ? argv[i + 1] : NULL);
+        } else if (strcmp(argv[i], "--midi-bench") == 0) {
+            freeDeque(dq);
+            run_midi_benchmark(i + 1 < argc ? atof(argv[i + 1]) : 64.0);
+            return 0;
+        } else if (strcmp(argv[i], "--smf-bench") == 0 && i + 1 < argc) {
+            trace = false;
+            freeDeque(dq);
+            return run_smf(argv[i + 1], false, i + 2 < argc ? atoi(argv[i + 2]) : 10);
+#endif
+        } else if (strcmp(argv[i], "--synth") == 0 || strcmp(argv[i], "--synth-bench") == 0) {
+            // --synth [wave] [seconds] [out.raw], --synth-bench [wave] [seconds]
+            bool bench = strcmp(argv[i], "--synth-bench") == 0;
+            SynthWave wave = WAVE_SINE;
+            if (i + 1 < argc && !parse_wave(argv[i + 1], &wave)) return 1;
+            double seconds = i + 2 < argc ? atof(argv[i + 2]) : bench ? 10.0 : 8.0;
+            freeDeque(dq);
+            if (!bench) return run_synth(wave, seconds, i + 3 < argc ? argv[i + 3] : NULL);
+            if (i + 1 < argc) {
+                run_synth_benchmark(wave, seconds);
+            } else {
+                for (int w = 0; w < WAVE_COUNT; w++) run_synth_benchmark((SynthWave)w, seconds);
+            }
+            return 0;
+        } else if (strcmp(argv[i], "--channels") == 0) {
+            run_channel_demo();
+            freeDeque(dq);
+            return 0;
+        } else if (strcmp(argv[i], "--mono") == 0) {
+            // --mono [last|low|high] [legato]
+            MonoPriority priority = MONO_LAST;
+            if (i + 1 < argc) {
+                for (int p = 0; p < MONO_PRIORITY_COUNT; p++) {
+                    if (strcmp(argv[i + 1], mono_priority_names[p]) == 0) priority = (MonoPriority)p;
+                }
+            }
+            run_mono_demo(priority, i + 2 < argc && strcmp(argv[i + 2], "legato") == 0);
+            freeDeque(dq);
+            return 0;
+        } else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc) {
+            i++;
+            for (int p = 0; p < STEAL_POLICY_COUNT; p++) {
+                if (strcmp(argv[i], steal_policy_names[p]) == 0) dq->policy = (StealPolicy)p;
+            }
+        } else if (strcmp(argv[i], "--protect-bass") == 0) {
+            dq->protect_bass = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--record file.vtr] [--stats file.json|file.bin|-] [mode]\n"
+                            "  (no mode)                 fixed + random note test\n"
+                            "    [--policy oldest|quietest|lowest|highest|released] [--protect-bass]\n"
+                            "  --channels                multitimbral demo\n"
+                            "  --mono [last|low|high] [legato]  monophonic note priority demo\n"
+                            "  --smf file.mid [--fast]   play a MIDI file\n"
+                            "  --smf-bench file.mid [n]  MIDI file throughput\n"
+                            "  --midi-in [file|fifo|-]   play a raw MIDI byte stream (stdin by default)\n"
+                            "  --midi-bench [MB]         raw MIDI parser throughput\n"
+                            "  --threads [seconds]       MIDI input -> render thread demo\n"
+                            "  --replay file.vtr         replay a recording and diff its decisions\n"
+                            "  --synth [wave] [s] [file] render 16-bit 48 kHz PCM (stdout by default)\n"
+                            "  --synth-bench [wave] [s]  voices rendered in real time per core\n"
+                            "  --stats-dump file.bin     print a binary stats snapshot as JSON\n"
+                            "  --bench [events]          stealing policy benchmark\n", argv[0]);
+            return 1;
+        }
+    }
+
+    recordDeque(dq);
 
     // Test 1 - known values
     noteOn(dq, 60);
@@ -222,7 +2588,9 @@ int main() {
         random_note_event(dq);
     }
 
+    print_held_notes(dq);
     dumpDeque(dq);
     return 0;
 }
+#endif // VOICE_TRACKER_LIB
 
@@ -0,0 +1,73 @@
+/*
+ *
+ * voice_tracker.h - stable C ABI for the voice tracker core.
+ * (c) seclorun 2025
+ *
+ * MIT Licensed - see LICENSE
+ *
+ * Build the shared library with 'make libvoicetracker.so'. Only the vt_*
+ * functions below are exported. Handles are opaque, and everything is plain
+ * ints, so the declarations can be pasted into a LuaJIT ffi.cdef (see
+ * voice_tracker_ffi.lua). Bump VT_ABI_VERSION on any incompatible change.
+ *
+ */
+#ifndef VOICE_TRACKER_H
+#define VOICE_TRACKER_H
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#define VT_API __declspec(dllexport)
+#else
+#define VT_API __attribute__((visibility("default")))
+#endif
+
+#define VT_ABI_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct vt_deque vt_deque;       // one channel of held notes, MAX_VOICES voices
+typedef struct vt_tracker vt_tracker;   // 16 MIDI channels sharing a voice budget
+
+// Same layout as the tracker's NoteEvent
+typedef struct {
+    uint64_t time_ns;
+    uint8_t type;                       // 1 = note on, 0 = note off
+    uint8_t channel;                    // 0-15
+    uint8_t note;
+    uint8_t velocity;
+} vt_event;
+
+VT_API int vt_abi_version(void);
+VT_API void vt_set_trace(int on);       // print voice changes to stdout (off by default)
+
+// Policies: "oldest", "quietest", "lowest", "highest", "released"
+VT_API vt_deque* vt_deque_new(void);
+VT_API void vt_deque_free(vt_deque* d);
+VT_API int vt_deque_set_policy(vt_deque* d, const char* policy, int protect_bass, int hold_releases);
+VT_API void vt_note_on(vt_deque* d, int note, int velocity);
+VT_API void vt_note_off(vt_deque* d, int note);
+VT_API void vt_voice_finished(vt_deque* d, int note);
+VT_API int vt_held_count(vt_deque* d);
+VT_API int vt_held_notes(vt_deque* d, int* notes, int max);    // newest first, returns count
+VT_API unsigned long vt_deque_steals(vt_deque* d);
+
+VT_API vt_tracker* vt_tracker_new(int budget);
+VT_API void vt_tracker_free(vt_tracker* t);
+VT_API int vt_tracker_set_channel(vt_tracker* t, int ch, int reserve, int limit);
+VT_API int vt_tracker_set_policy(vt_tracker* t, int ch, const char* policy, int protect_bass, int hold_releases);
+VT_API int vt_tracker_note_on(vt_tracker* t, int ch, int note, int velocity);      // slot, or -1 if dropped
+VT_API void vt_tracker_note_off(vt_tracker* t, int ch, int note);
+VT_API void vt_tracker_voice_finished(vt_tracker* t, int slot);
+VT_API int vt_tracker_apply(vt_tracker* t, const vt_event* events, int n);
+VT_API int vt_tracker_active(vt_tracker* t, int* slots, int max);                   // returns count
+VT_API int vt_tracker_voice(vt_tracker* t, int slot, int* ch, int* note, int* velocity);  // -1 if free
+VT_API unsigned long vt_tracker_steals(vt_tracker* t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VOICE_TRACKER_H
@@ -6,6 +6,7 @@
 local MAX_VOICES = 8
 local NOTE_ON = 1
 local NOTE_OFF = 0
+local trace = true -- print every voice change
 
 -- High-resolution time function using ffi
 local ffi = require("ffi")
@@ -88,11 +89,17 @@ function Deque:printContents()
 end
 
 local function synth_voice_ts(voicenum, state, dq)
+    if not trace then return end
     print(string.format("Voice %d: [%d ms] %s", voicenum, current_time_ms(), state == NOTE_ON and "NOTE ON" or "NOTE OFF"))
     dq:printContents()
 end
 
 local function noteOn(dq, note)
+    if dq:contains(note) then
+        -- A repeated note keeps its voice, as in voice_tracker.c
+        synth_voice_ts(note, NOTE_ON, dq)
+        return
+    end
     if dq.size >= MAX_VOICES then
         local stolenNote = dq:popBack()
         if stolenNote then
@@ -118,6 +125,18 @@ local function random_note_event(dq)
     end
 end
 
+-- require("voice_tracker") gets the implementation without running the test
+if ... == "voice_tracker" then
+    return {
+        Deque = Deque,
+        noteOn = noteOn,
+        noteOff = noteOff,
+        MAX_VOICES = MAX_VOICES,
+        current_time_ns = current_time_ns,
+        set_trace = function(on) trace = on end,
+    }
+end
+
 -- Main execution
 dq = Deque:new()
 noteOn(dq, 60)
@@ -0,0 +1,71 @@
+-- Pure-Lua voice tracker vs the C core through LuaJIT FFI
+-- Usage: luajit voice_tracker_bench.lua [events]   (after 'make libvoicetracker.so')
+-- (c) seclorun 2025
+-- MIT Licensed - see LICENSE
+
+package.path = "./?.lua;" .. package.path
+local lua_vt = require("voice_tracker")
+local vt = require("voice_tracker_ffi")
+
+local function now()
+    return tonumber(lua_vt.current_time_ns()) * 1e-9
+end
+
+local events = tonumber(arg[1]) or 1000000
+lua_vt.set_trace(false)
+
+-- One random event stream, replayed through every implementation
+math.randomseed(1)
+local notes, ons = {}, {}
+for i = 1, events do
+    notes[i] = math.random(36, 96)
+    ons[i] = math.random(10) <= 6
+end
+
+local function report(name, secs, held)
+    print(string.format("%-22s %8.1f ns/event %7.2f Mevents/s   held: %s",
+        name, secs * 1e9 / events, events / secs / 1e6, table.concat(held, ", ")))
+end
+
+-- Pure Lua
+local dq = lua_vt.Deque:new()
+local t0 = now()
+for i = 1, events do
+    if ons[i] then lua_vt.noteOn(dq, notes[i]) else lua_vt.noteOff(dq, notes[i]) end
+end
+local lua_held = dq.items
+report("pure Lua", now() - t0, lua_held)
+
+-- C core, one FFI call per event
+local d = vt.deque()
+t0 = now()
+for i = 1, events do
+    if ons[i] then d:note_on(notes[i]) else d:note_off(notes[i]) end
+end
+local ffi_held = d:held()
+report("FFI deque", now() - t0, ffi_held)
+
+-- C core, 16-channel tracker fed in batches of 64 events
+local batch = vt.events(64)
+local tr = vt.tracker(8)
+t0 = now()
+local n = 0
+for i = 1, events do
+    local e = batch[n]
+    e.type = ons[i] and vt.NOTE_ON or vt.NOTE_OFF
+    e.channel = 0
+    e.note = notes[i]
+    e.velocity = 100
+    n = n + 1
+    if n == 64 then tr:apply(batch, n); n = 0 end
+end
+tr:apply(batch, n)
+local secs = now() - t0
+local voiced = {}
+for _, v in ipairs(tr:voices()) do voiced[#voiced + 1] = v.note end
+table.sort(voiced, function(a, b) return a > b end)
+report("FFI tracker, batched", secs, voiced)
+
+local same = #lua_held == #ffi_held
+for i = 1, #lua_held do same = same and lua_held[i] == ffi_held[i] end
+print(same and "pure Lua and FFI deques agree" or "pure Lua and FFI deques DIFFER")
@@ -0,0 +1,126 @@
+-- LuaJIT FFI bindings for the C voice tracker core (libvoicetracker.so)
+-- Scripts drive the same allocation-free C code as voice_tracker.c itself.
+-- (c) seclorun 2025
+-- MIT Licensed - see LICENSE
+--
+--   local vt = require("voice_tracker_ffi")
+--   local d = vt.deque()
+--   d:note_on(60, 100)
+--   print(table.concat(d:held(), ", "))
+--
+-- The library path can be overridden with VOICE_TRACKER_LIB.
+
+local ffi = require("ffi")
+
+-- Keep in step with voice_tracker.h
+ffi.cdef[[
+    typedef struct vt_deque vt_deque;
+    typedef struct vt_tracker vt_tracker;
+    typedef struct {
+        uint64_t time_ns;
+        uint8_t type;
+        uint8_t channel;
+        uint8_t note;
+        uint8_t velocity;
+    } vt_event;
+
+    int vt_abi_version(void);
+    void vt_set_trace(int on);
+
+    vt_deque* vt_deque_new(void);
+    void vt_deque_free(vt_deque* d);
+    int vt_deque_set_policy(vt_deque* d, const char* policy, int protect_bass, int hold_releases);
+    void vt_note_on(vt_deque* d, int note, int velocity);
+    void vt_note_off(vt_deque* d, int note);
+    void vt_voice_finished(vt_deque* d, int note);
+    int vt_held_count(vt_deque* d);
+    int vt_held_notes(vt_deque* d, int* notes, int max);
+    unsigned long vt_deque_steals(vt_deque* d);
+
+    vt_tracker* vt_tracker_new(int budget);
+    void vt_tracker_free(vt_tracker* t);
+    int vt_tracker_set_channel(vt_tracker* t, int ch, int reserve, int limit);
+    int vt_tracker_set_policy(vt_tracker* t, int ch, const char* policy, int protect_bass, int hold_releases);
+    int vt_tracker_note_on(vt_tracker* t, int ch, int note, int velocity);
+    void vt_tracker_note_off(vt_tracker* t, int ch, int note);
+    void vt_tracker_voice_finished(vt_tracker* t, int slot);
+    int vt_tracker_apply(vt_tracker* t, const vt_event* events, int n);
+    int vt_tracker_active(vt_tracker* t, int* slots, int max);
+    int vt_tracker_voice(vt_tracker* t, int slot, int* ch, int* note, int* velocity);
+    unsigned long vt_tracker_steals(vt_tracker* t);
+]]
+
+local ABI_VERSION = 1
+local DEFAULT_VELOCITY = 100
+
+local C = ffi.load(os.getenv("VOICE_TRACKER_LIB") or "./libvoicetracker.so")
+if C.vt_abi_version() ~= ABI_VERSION then
+    error(string.format("libvoicetracker ABI %d, bindings expect %d", C.vt_abi_version(), ABI_VERSION))
+end
+
+local scratch = ffi.new("int[128]")
+local out_ch, out_note, out_vel = ffi.new("int[1]"), ffi.new("int[1]"), ffi.new("int[1]")
+
+-- Single-channel deque, the C noteOn/noteOff API
+local Deque = {}
+Deque.__index = Deque
+
+function Deque:note_on(note, velocity) C.vt_note_on(self.h, note, velocity or DEFAULT_VELOCITY) end
+function Deque:note_off(note) C.vt_note_off(self.h, note) end
+function Deque:voice_finished(note) C.vt_voice_finished(self.h, note) end
+function Deque:count() return C.vt_held_count(self.h) end
+function Deque:steals() return tonumber(C.vt_deque_steals(self.h)) end
+
+function Deque:set_policy(policy, protect_bass, hold_releases)
+    return C.vt_deque_set_policy(self.h, policy, protect_bass and 1 or 0, hold_releases and 1 or 0) == 0
+end
+
+-- Held notes, newest first
+function Deque:held()
+    local n, t = C.vt_held_notes(self.h, scratch, 128), {}
+    for i = 0, n - 1 do t[#t + 1] = scratch[i] end
+    return t
+end
+
+-- 16-channel tracker with a shared voice budget
+local Tracker = {}
+Tracker.__index = Tracker
+
+function Tracker:note_on(ch, note, velocity) return C.vt_tracker_note_on(self.h, ch, note, velocity or DEFAULT_VELOCITY) end
+function Tracker:note_off(ch, note) C.vt_tracker_note_off(self.h, ch, note) end
+function Tracker:voice_finished(slot) C.vt_tracker_voice_finished(self.h, slot) end
+function Tracker:set_channel(ch, reserve, limit) return C.vt_tracker_set_channel(self.h, ch, reserve, limit) == 0 end
+function Tracker:steals() return tonumber(C.vt_tracker_steals(self.h)) end
+
+function Tracker:set_policy(ch, policy, protect_bass, hold_releases)
+    return C.vt_tracker_set_policy(self.h, ch, policy, protect_bass and 1 or 0, hold_releases and 1 or 0) == 0
+end
+
+-- events: a "vt_event[?]" array from vt.events(n); returns note-ons sounding
+function Tracker:apply(events, n) return C.vt_tracker_apply(self.h, events, n) end
+
+-- Busy voices as { slot, channel, note, velocity } tables
+function Tracker:voices()
+    local n, t = C.vt_tracker_active(self.h, scratch, 128), {}
+    for i = 0, math.min(n, 128) - 1 do
+        local slot = scratch[i]
+        C.vt_tracker_voice(self.h, slot, out_ch, out_note, out_vel)
+        t[#t + 1] = { slot = slot, channel = out_ch[0], note = out_note[0], velocity = out_vel[0] }
+    end
+    return t
+end
+
+local M = { C = C, NOTE_ON = 1, NOTE_OFF = 0 }
+
+function M.deque()
+    return setmetatable({ h = ffi.gc(C.vt_deque_new(), C.vt_deque_free) }, Deque)
+end
+
+function M.tracker(budget)
+    return setmetatable({ h = ffi.gc(C.vt_tracker_new(budget or 32), C.vt_tracker_free) }, Tracker)
+end
+
+function M.events(n) return ffi.new("vt_event[?]", n) end
+function M.set_trace(on) C.vt_set_trace(on and 1 or 0) end
+
+return M